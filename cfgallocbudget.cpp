@@ -0,0 +1,167 @@
+// Copyright (C) 2014-2016 Eric Hebert (ayebear)
+// This code is licensed under MIT, see LICENSE.txt for details.
+
+// Checks that loading, lookups, and saving don't allocate more than they used to
+// Every heap allocation is counted while each path runs over a fixed corpus, and the test fails
+// if the allocations per line (or per call) go over the budgets recorded below.
+// Usage: cfgallocbudget [temporary file for loadFromFile]
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <new>
+#include <string>
+#include <vector>
+#include "configfile.h"
+#include "strlib.h"
+
+namespace
+{
+
+std::atomic<size_t> allocations{0};
+
+// Allocations per line or per call, measured when the budgets were recorded (with a little room)
+// Lower these when a change allocates less, so it can't come back unnoticed
+const double loadFromStringBudget = 3.5; // Per line (3.25 when recorded)
+const double loadFromFileBudget = 3.5; // Per line (3.25 when recorded)
+const double findBudget = 0; // Per lookup
+const double getBudget = 0; // Per lookup
+const double operatorBudget = 0; // Per lookup of an existing option
+const double setStringBudget = 0.01; // Per call, the text reuses its capacity (0.0001 when recorded)
+const double writeUnchangedBudget = 0; // Per call, when nothing changed (the output reuses its capacity)
+const double writeChangedBudget = 650; // Per call, after one option changed (591 when recorded, the section has 300 options)
+
+// The corpus has every kind of line, so each part of the parser is counted
+std::string buildCorpus(unsigned sections, unsigned optionsPerSection)
+{
+    std::string corpus("// Generated corpus for counting allocations\n\nglobal = 1\n");
+    for (unsigned s = 0; s < sections; ++s)
+    {
+        corpus += "\n[Section" + std::to_string(s) + "]\n";
+        for (unsigned o = 0; o < optionsPerSection; ++o)
+        {
+            std::string n = std::to_string(o);
+            corpus += "int" + n + " = " + n + '\n';
+            corpus += "float" + n + " = " + n + ".25 // Trailing comment\n";
+            corpus += "string" + n + " = \"A string that is too long to fit in a string object " + n + "\"\n";
+            corpus += "short" + n + " = 'abc'\n";
+            corpus += "numbers" + n + " = {1, 2, 3, 4, 5, 6, 7, 8, 9, " + n + "}\n";
+            corpus += "mixed" + n + " = {\n\t1,\n\t\"two\",\n\t{3, 4}\n}\n";
+            corpus += "/* A block\ncomment */\n";
+        }
+    }
+    return corpus;
+}
+
+size_t countLines(const std::string& str)
+{
+    return strlib::getLinesFromString(str).size();
+}
+
+// Runs a function "count" times, and returns the allocations per run
+template <typename Function>
+double measure(unsigned count, Function function)
+{
+    size_t before = allocations.load();
+    for (unsigned i = 0; i < count; ++i)
+        function(i);
+    return static_cast<double>(allocations.load() - before) / count;
+}
+
+bool check(const char* name, double measured, double budget)
+{
+    bool passed = (measured <= budget);
+    std::cout << (passed ? "   ok  " : "  FAIL ") << name << ": " << measured << " allocations (budget " << budget << ")\n";
+    return passed;
+}
+
+}
+
+void* operator new(std::size_t size)
+{
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* ptr = std::malloc(size ? size : 1))
+        return ptr;
+    throw std::bad_alloc();
+}
+
+void* operator new[](std::size_t size)
+{
+    return operator new(size);
+}
+
+void operator delete(void* ptr) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete[](void* ptr) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete(void* ptr, std::size_t) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete[](void* ptr, std::size_t) noexcept
+{
+    std::free(ptr);
+}
+
+int main(int argc, char** argv)
+{
+    const unsigned sections = 20;
+    const unsigned optionsPerSection = 50;
+    const unsigned lookups = 10000;
+    std::string filename = (argc > 1 ? argv[1] : "cfgallocbudget.cfg");
+
+    std::string corpus = buildCorpus(sections, optionsPerSection);
+    double lines = static_cast<double>(countLines(corpus));
+    if (!strlib::writeStringToFile(filename, corpus))
+    {
+        std::cout << "Could not write \"" << filename << "\"\n";
+        return 1;
+    }
+
+    bool passed = true;
+    cfg::File file(cfg::File::ConfigMap{}, cfg::File::NoFlags);
+    cfg::File fileFromDisk(cfg::File::ConfigMap{}, cfg::File::NoFlags);
+
+    // Loading (into empty files)
+    double measured = measure(1, [&](unsigned){ file.loadFromString(corpus); }) / lines;
+    passed &= check("loadFromString (per line)", measured, loadFromStringBudget);
+    measured = measure(1, [&](unsigned){ fileFromDisk.loadFromFile(filename); }) / lines;
+    passed &= check("loadFromFile (per line)", measured, loadFromFileBudget);
+    std::remove(filename.c_str());
+
+    // Lookups, with the names made before counting
+    std::vector<std::pair<std::string, std::string>> names;
+    for (unsigned i = 0; i < lookups; ++i)
+        names.emplace_back("string" + std::to_string(i % optionsPerSection), "Section" + std::to_string(i % sections));
+    const cfg::File& constFile = file;
+    measured = measure(lookups, [&](unsigned i){ constFile.find(names[i].first, names[i].second); });
+    passed &= check("find (per lookup)", measured, findBudget);
+    measured = measure(lookups, [&](unsigned i){ constFile.get(names[i].first, names[i].second, 0); });
+    passed &= check("get (per lookup)", measured, getBudget);
+    measured = measure(lookups, [&](unsigned i){ file(names[i].first, names[i].second); });
+    passed &= check("operator() (per lookup)", measured, operatorBudget);
+
+    // Setting values
+    cfg::Option& option = file("string0", "Section0");
+    const std::string values[] = {"Another string that is too long to fit in a string object", "A different string that is also too long to fit"};
+    measured = measure(lookups, [&](unsigned i){ option.setString(values[i % 2]); });
+    passed &= check("Option::setString (per call)", measured, setStringBudget);
+
+    // Saving
+    std::string output;
+    file.writeToString(output); // Fills the cache
+    measured = measure(100, [&](unsigned){ output.clear(); file.writeToString(output); });
+    passed &= check("writeToString unchanged (per call)", measured, writeUnchangedBudget);
+    measured = measure(100, [&](unsigned i){ file("int0", "Section" + std::to_string(i % sections)) = i; output.clear(); file.writeToString(output); });
+    passed &= check("writeToString after a change (per call)", measured, writeChangedBudget);
+
+    return (passed ? 0 : 1);
+}
@@ -0,0 +1,161 @@
+// Copyright (C) 2014-2016 Eric Hebert (ayebear)
+// This code is licensed under MIT, see LICENSE.txt for details.
+
+// Generates C++ data from a config file, so it can be loaded without parsing (see configembed.h)
+// Usage: cfgembed input.cfg output.cpp output.h name
+
+#include <cmath>
+#include <cstdio>
+#include <iostream>
+#include <limits>
+#include <sstream>
+#include "configfile.h"
+#include "strlib.h"
+
+namespace
+{
+
+// Converts a string to a C++ string literal
+std::string makeLiteral(const std::string& str)
+{
+    std::string literal("\"");
+    for (char c: str)
+    {
+        if (c == '"' || c == '\\')
+        {
+            literal += '\\';
+            literal += c;
+        }
+        else if (c == '\n')
+            literal += "\\n";
+        else if (c == '\t')
+            literal += "\\t";
+        else if (static_cast<unsigned char>(c) < 32 || c == 127)
+        {
+            // Octal escapes always use 3 digits, so they do not run into the next character
+            char escape[5];
+            std::snprintf(escape, sizeof(escape), "\\%03o", static_cast<unsigned char>(c));
+            literal += escape;
+        }
+        else
+            literal += c;
+    }
+    return literal + '"';
+}
+
+std::string makeLiteral(long value)
+{
+    if (value == std::numeric_limits<long>::min())
+        return "std::numeric_limits<long>::min()";
+    return strlib::toString(value) + 'L';
+}
+
+std::string makeLiteral(double value)
+{
+    if (std::isnan(value))
+        return "std::numeric_limits<double>::quiet_NaN()";
+    if (std::isinf(value))
+        return (value < 0 ? "-std::numeric_limits<double>::infinity()" : "std::numeric_limits<double>::infinity()");
+    std::string literal = strlib::toString(value); // Shortest text that converts back exactly
+    if (literal.find_first_of(".e") == std::string::npos)
+        literal += ".0";
+    return literal;
+}
+
+class Generator
+{
+    public:
+        void writeConfig(cfg::File& file, const std::string& name, std::ostream& out)
+        {
+            std::ostringstream sections;
+            std::ostringstream options;
+            unsigned sectionCount = 0;
+            for (auto& section: file)
+            {
+                std::string optionsName = "options" + strlib::toString(sectionCount);
+                options << "const EmbeddedOption " << optionsName << "[] = {\n";
+                for (auto& option: section.second)
+                {
+                    std::string value = writeValue(option.second);
+                    options << "    {" << makeLiteral(option.first) << ", " << option.first.size() << ", " << value << "},\n";
+                }
+                options << "    {}\n};\n\n"; // Keeps empty sections from being an empty array
+                sections << "    {" << makeLiteral(section.first) << ", " << section.first.size() << ", "
+                    << section.second.size() << ", " << optionsName << "},\n";
+                ++sectionCount;
+            }
+            out << "#include <limits>\n";
+            out << "#include \"configembed.h\"\n\n";
+            out << "namespace cfg\n{\n\nnamespace\n{\n\n";
+            out << elements.str() << options.str();
+            out << "const EmbeddedSection sections[] = {\n" << sections.str() << "    {}\n};\n\n}\n\n";
+            out << "namespace embedded\n{\n\n";
+            out << "extern const EmbeddedConfig " << name << " = {" << sectionCount << ", sections};\n\n";
+            out << "}\n\n}\n";
+        }
+
+    private:
+        // Returns the initializer of a value, and writes the arrays of its elements first
+        std::string writeValue(cfg::Option& option)
+        {
+            std::string elementsName = "nullptr";
+            unsigned size = option.size();
+            if (size > 0)
+            {
+                std::vector<std::string> values;
+                for (unsigned i = 0; i < size; ++i)
+                    values.push_back(writeValue(option[i]));
+                elementsName = "elements" + strlib::toString(elementCount++);
+                elements << "const EmbeddedValue " << elementsName << "[] = {\n";
+                for (const auto& value: values)
+                    elements << "    " << value << ",\n";
+                elements << "};\n\n";
+            }
+            const std::string& text = option.toString();
+            std::ostringstream value;
+            value << '{' << makeLiteral(text) << ", " << text.size() << ", " << makeLiteral(option.toLong()) << ", "
+                << makeLiteral(option.toDouble()) << ", " << (option.toBool() ? "true" : "false") << ", "
+                << (option.hasQuotes() ? "true" : "false") << ", " << size << ", " << elementsName << '}';
+            return value.str();
+        }
+
+        std::ostringstream elements;
+        unsigned elementCount{};
+};
+
+}
+
+int main(int argc, char** argv)
+{
+    if (argc != 5)
+    {
+        std::cerr << "Usage: cfgembed input.cfg output.cpp output.h name\n";
+        return 1;
+    }
+    std::string inputName = argv[1];
+    std::string name = argv[4];
+
+    cfg::File file;
+    if (!file.loadFromFile(inputName))
+        return 1;
+
+    std::ostringstream source;
+    source << "// Generated by cfgembed from " << inputName << ", do not edit\n\n";
+    Generator().writeConfig(file, name, source);
+
+    std::string guard = "CFG_EMBEDDED_" + name + "_H";
+    std::ostringstream header;
+    header << "// Generated by cfgembed from " << inputName << ", do not edit\n\n";
+    header << "#ifndef " << guard << "\n#define " << guard << "\n\n";
+    header << "#include \"configembed.h\"\n\n";
+    header << "namespace cfg\n{\n\nnamespace embedded\n{\n\n";
+    header << "extern const EmbeddedConfig " << name << ";\n\n";
+    header << "}\n\n}\n\n#endif\n";
+
+    if (!strlib::writeStringToFile(argv[2], source.str()) || !strlib::writeStringToFile(argv[3], header.str()))
+    {
+        std::cerr << "Error writing the output files\n";
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,448 @@
+// Copyright (C) 2014-2016 Eric Hebert (ayebear)
+// This code is licensed under MIT, see LICENSE.txt for details.
+
+#include "configasync.h"
+#include <algorithm>
+#include "strlib.h"
+
+#ifdef CFG_USE_IO_URING
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace cfg
+{
+
+#ifdef CFG_USE_IO_URING
+
+// A minimal io_uring, using the system calls directly
+struct AsyncIo::Ring
+{
+    // An open file with a read/write in progress
+    struct Operation
+    {
+        RequestPtr request;
+        int fd;
+        size_t offset;
+    };
+
+    bool init(unsigned queueSize);
+    ~Ring();
+    void queue(Operation* op); // Adds an entry to the submission queue
+    std::vector<Operation*> unqueue(unsigned count); // Takes back the last entries that were not submitted
+    int enter(unsigned toSubmit, unsigned minComplete);
+
+    int fd{-1};
+    unsigned entries{};
+    void* sqPtr{MAP_FAILED};
+    size_t sqSize{};
+    void* cqPtr{MAP_FAILED};
+    size_t cqSize{};
+    io_uring_sqe* sqes{static_cast<io_uring_sqe*>(MAP_FAILED)};
+    size_t sqesSize{};
+    unsigned* sqTail{};
+    unsigned* sqMask{};
+    unsigned* sqArray{};
+    unsigned* cqHead{};
+    unsigned* cqTail{};
+    unsigned* cqMask{};
+    io_uring_cqe* cqes{};
+
+    // Requests waiting to be started by the ring thread
+    std::mutex mutex;
+    std::condition_variable pending;
+    std::deque<RequestPtr> requests;
+    bool stopping{};
+};
+
+bool AsyncIo::Ring::init(unsigned queueSize)
+{
+    io_uring_params params;
+    std::memset(&params, 0, sizeof(params));
+    fd = static_cast<int>(syscall(__NR_io_uring_setup, queueSize, &params));
+    if (fd < 0)
+        return false;
+
+    // IORING_OP_READ/WRITE were added in the same kernel version as this feature
+    if (!(params.features & IORING_FEAT_RW_CUR_POS))
+        return false;
+
+    entries = params.sq_entries;
+    sqSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cqSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    bool singleMap = (params.features & IORING_FEAT_SINGLE_MMAP);
+    if (singleMap)
+        sqSize = cqSize = std::max(sqSize, cqSize);
+
+    sqPtr = mmap(nullptr, sqSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    if (sqPtr == MAP_FAILED)
+        return false;
+    if (!singleMap)
+    {
+        cqPtr = mmap(nullptr, cqSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+        if (cqPtr == MAP_FAILED)
+            return false;
+    }
+    sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+    sqes = static_cast<io_uring_sqe*>(mmap(nullptr, sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES));
+    if (sqes == MAP_FAILED)
+        return false;
+
+    char* sq = static_cast<char*>(sqPtr);
+    char* cq = static_cast<char*>(singleMap ? sqPtr : cqPtr);
+    sqTail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+    sqMask = reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+    sqArray = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+    cqHead = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+    cqTail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+    cqMask = reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+    cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+    return true;
+}
+
+AsyncIo::Ring::~Ring()
+{
+    if (sqes != MAP_FAILED)
+        munmap(sqes, sqesSize);
+    if (cqPtr != MAP_FAILED)
+        munmap(cqPtr, cqSize);
+    if (sqPtr != MAP_FAILED)
+        munmap(sqPtr, sqSize);
+    if (fd >= 0)
+        close(fd);
+}
+
+void AsyncIo::Ring::queue(Operation* op)
+{
+    // Only the ring thread submits, so the tail only needs to be published
+    unsigned tail = *sqTail;
+    unsigned index = tail & *sqMask;
+    io_uring_sqe* sqe = &sqes[index];
+    std::memset(sqe, 0, sizeof(*sqe));
+    auto& data = op->request->data;
+    sqe->opcode = (op->request->write ? IORING_OP_WRITE : IORING_OP_READ);
+    sqe->fd = op->fd;
+    sqe->off = op->offset;
+    sqe->addr = reinterpret_cast<unsigned long long>(&data[op->offset]);
+    sqe->len = static_cast<unsigned>(std::min<size_t>(data.size() - op->offset, 1u << 30));
+    sqe->user_data = reinterpret_cast<unsigned long long>(op);
+    sqArray[index] = index;
+    __atomic_store_n(sqTail, tail + 1, __ATOMIC_RELEASE);
+}
+
+std::vector<AsyncIo::Ring::Operation*> AsyncIo::Ring::unqueue(unsigned count)
+{
+    // The kernel only reads entries during io_uring_enter, so these were never seen
+    std::vector<Operation*> ops;
+    unsigned tail = *sqTail;
+    for (unsigned i = tail - count; i != tail; ++i)
+        ops.push_back(reinterpret_cast<Operation*>(sqes[i & *sqMask].user_data));
+    __atomic_store_n(sqTail, tail - count, __ATOMIC_RELEASE);
+    return ops;
+}
+
+int AsyncIo::Ring::enter(unsigned toSubmit, unsigned minComplete)
+{
+    int result;
+    do
+        result = static_cast<int>(syscall(__NR_io_uring_enter, fd, toSubmit, minComplete, IORING_ENTER_GETEVENTS, nullptr, 0));
+    while (result < 0 && errno == EINTR);
+    return result;
+}
+
+void AsyncIo::runRing()
+{
+    using Operation = Ring::Operation;
+    std::deque<RequestPtr> waiting; // Requests that have not been started yet
+    unsigned inFlight{0};
+    unsigned toSubmit{0};
+    while (true)
+    {
+        {
+            std::unique_lock<std::mutex> lock(ring->mutex);
+            if (inFlight == 0 && waiting.empty())
+                ring->pending.wait(lock, [&]{ return ring->stopping || !ring->requests.empty(); });
+            if (ring->stopping && inFlight == 0 && waiting.empty() && ring->requests.empty())
+                break;
+            waiting.insert(waiting.end(), ring->requests.begin(), ring->requests.end());
+            ring->requests.clear();
+        }
+
+        // Start as many operations as there is room for
+        while (!waiting.empty() && inFlight < ring->entries)
+        {
+            auto request = std::move(waiting.front());
+            waiting.pop_front();
+            int fd = (request->write ? open(request->filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644)
+                                     : open(request->filename.c_str(), O_RDONLY | O_CLOEXEC));
+            if (fd < 0)
+            {
+                complete(request, false);
+                continue;
+            }
+            if (!request->write)
+            {
+                struct stat st;
+                if (fstat(fd, &st) != 0)
+                {
+                    close(fd);
+                    complete(request, false);
+                    continue;
+                }
+                // Reading one byte past the limit is enough for the parser to reject the file
+                size_t size = st.st_size;
+                if (request->maxBytes)
+                    size = std::min(size, request->maxBytes);
+                request->data.resize(size);
+            }
+            if (request->data.empty())
+            {
+                // Nothing to read/write
+                close(fd);
+                complete(request, true);
+                continue;
+            }
+            ring->queue(new Operation{std::move(request), fd, 0});
+            ++inFlight;
+            ++toSubmit;
+        }
+
+        if (inFlight == 0)
+            continue;
+
+        // Submit everything at once, and wait for at least one completion
+        int submitted = ring->enter(toSubmit, 1);
+        bool failed = (submitted < 0);
+        if (!failed)
+            toSubmit -= std::min<unsigned>(submitted, toSubmit); // The rest stay queued
+        else if (errno != EBUSY && errno != EAGAIN)
+        {
+            // The queued entries can not be submitted, so fail them
+            // Busy errors are not handled here, since reaping completions makes room
+            for (auto op: ring->unqueue(toSubmit))
+            {
+                close(op->fd);
+                complete(op->request, false);
+                delete op;
+                --inFlight;
+            }
+            toSubmit = 0;
+        }
+
+        unsigned head = *ring->cqHead;
+        if (failed && head == __atomic_load_n(ring->cqTail, __ATOMIC_ACQUIRE))
+            std::this_thread::yield(); // Nothing to reap, so give the kernel time before trying again
+        while (head != __atomic_load_n(ring->cqTail, __ATOMIC_ACQUIRE))
+        {
+            const io_uring_cqe& cqe = ring->cqes[head & *ring->cqMask];
+            auto op = reinterpret_cast<Operation*>(cqe.user_data);
+            int result = cqe.res;
+            ++head;
+
+            auto& data = op->request->data;
+            bool retry = (result == -EINTR || result == -EAGAIN);
+            if (result > 0)
+                op->offset += result;
+            if (!retry && (result <= 0 || op->offset >= data.size()))
+            {
+                // A read ending early means the file got smaller
+                bool isRead = !op->request->write;
+                if (result == 0 && isRead)
+                    data.resize(op->offset);
+                close(op->fd);
+                complete(op->request, (result > 0 || (result == 0 && isRead)));
+                delete op;
+                --inFlight;
+            }
+            else
+            {
+                ring->queue(op); // Continue a short read/write
+                ++toSubmit;
+            }
+        }
+        __atomic_store_n(ring->cqHead, head, __ATOMIC_RELEASE);
+    }
+}
+
+#else
+
+struct AsyncIo::Ring
+{
+};
+
+void AsyncIo::runRing()
+{
+}
+
+#endif
+
+AsyncIo& AsyncIo::getInstance()
+{
+    static AsyncIo instance;
+    return instance;
+}
+
+AsyncIo::AsyncIo()
+{
+    unsigned threadCount = std::max(2u, std::thread::hardware_concurrency());
+    for (unsigned i = 0; i < threadCount; ++i)
+        workers.emplace_back(&AsyncIo::runWorker, this);
+
+#ifdef CFG_USE_IO_URING
+    ring = std::make_unique<Ring>();
+    if (ring->init(64))
+        ringThread = std::thread(&AsyncIo::runRing, this);
+    else
+        ring.reset(); // Use the thread pool for IO instead
+#endif
+}
+
+AsyncIo::~AsyncIo()
+{
+#ifdef CFG_USE_IO_URING
+    // The ring posts completions to the thread pool, so it needs to stop first
+    if (ring)
+    {
+        {
+            std::lock_guard<std::mutex> lock(ring->mutex);
+            ring->stopping = true;
+        }
+        ring->pending.notify_one();
+        ringThread.join();
+    }
+#endif
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    ready.notify_all();
+    for (auto& worker: workers)
+        worker.join();
+}
+
+AsyncIo::RequestPtr AsyncIo::makeRead(const std::string& filename, Completion done)
+{
+    auto request = std::make_shared<Request>();
+    request->filename = filename;
+    request->done = std::move(done);
+    return request;
+}
+
+AsyncIo::RequestPtr AsyncIo::makeWrite(const std::string& filename, std::string data, Completion done)
+{
+    auto request = makeRead(filename, std::move(done));
+    request->data = std::move(data);
+    request->write = true;
+    return request;
+}
+
+std::vector<std::future<bool>> AsyncIo::submit(const std::vector<RequestPtr>& requests)
+{
+    std::vector<std::future<bool>> futures;
+    futures.reserve(requests.size());
+    for (auto& request: requests)
+        futures.push_back(request->promise.get_future());
+
+#ifdef CFG_USE_IO_URING
+    if (ring)
+    {
+        // The whole batch is handed to the ring thread at once
+        {
+            std::lock_guard<std::mutex> lock(ring->mutex);
+            ring->requests.insert(ring->requests.end(), requests.begin(), requests.end());
+        }
+        ring->pending.notify_one();
+        return futures;
+    }
+#endif
+
+    for (auto& request: requests)
+    {
+        post([this, request]
+        {
+            bool status = (request->write ? strlib::writeStringToFile(request->filename, request->data)
+                                          : strlib::readStringFromFile(request->filename, request->data, request->maxBytes));
+            complete(request, status);
+        });
+    }
+    return futures;
+}
+
+std::future<bool> AsyncIo::submit(const RequestPtr& request)
+{
+    return std::move(submit(std::vector<RequestPtr>{request}).front());
+}
+
+std::future<bool> AsyncIo::run(std::function<bool()> task)
+{
+    auto promise = std::make_shared<std::promise<bool>>();
+    auto future = promise->get_future();
+    post([promise, task]
+    {
+        try
+        {
+            promise->set_value(task());
+        }
+        catch (...)
+        {
+            promise->set_exception(std::current_exception());
+        }
+    });
+    return future;
+}
+
+bool AsyncIo::usingIoUring() const
+{
+    return (ring != nullptr);
+}
+
+void AsyncIo::post(std::function<void()> task)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        tasks.push_back(std::move(task));
+    }
+    ready.notify_one();
+}
+
+void AsyncIo::complete(const RequestPtr& request, bool status)
+{
+    post([request, status]
+    {
+        try
+        {
+            bool result = status;
+            if (request->done)
+                result = request->done(status, request->data);
+            request->promise.set_value(result);
+        }
+        catch (...)
+        {
+            request->promise.set_exception(std::current_exception());
+        }
+    });
+}
+
+void AsyncIo::runWorker()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true)
+    {
+        ready.wait(lock, [&]{ return stopping || !tasks.empty(); });
+        if (tasks.empty())
+            break; // Only stops once all of the tasks are done
+        auto task = std::move(tasks.front());
+        tasks.pop_front();
+        lock.unlock();
+        task();
+        lock.lock();
+    }
+}
+
+}
@@ -0,0 +1,80 @@
+// Copyright (C) 2014-2016 Eric Hebert (ayebear)
+// This code is licensed under MIT, see LICENSE.txt for details.
+
+#ifndef CFG_ASYNC_H
+#define CFG_ASYNC_H
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace cfg
+{
+
+/*
+Runs file reads/writes without blocking the calling thread.
+On Linux, the IO is done with io_uring when the kernel supports it.
+Otherwise (or when it is disabled), blocking IO is done on a thread pool.
+Completions always run on the thread pool, so parsing does not hold up other IO.
+Results are returned with futures, since the library is built as C++17, which does not have coroutines.
+*/
+class AsyncIo
+{
+    public:
+        // Called on a pool thread once the IO is done, the return value is used for the future
+        // For reads, "data" contains the contents of the file
+        using Completion = std::function<bool(bool status, std::string& data)>;
+
+        struct Request
+        {
+            std::string filename;
+            std::string data; // What to write, or what was read
+            bool write{};
+            size_t maxBytes{}; // Reads stop after this many bytes (0 for no limit)
+            Completion done;
+            std::promise<bool> promise;
+        };
+        using RequestPtr = std::shared_ptr<Request>;
+
+        static AsyncIo& getInstance();
+        ~AsyncIo();
+
+        // Creates requests, which can be submitted together
+        static RequestPtr makeRead(const std::string& filename, Completion done);
+        static RequestPtr makeWrite(const std::string& filename, std::string data, Completion done);
+
+        std::vector<std::future<bool>> submit(const std::vector<RequestPtr>& requests); // Submits a batch of requests at once
+        std::future<bool> submit(const RequestPtr& request); // Submits a single request
+        std::future<bool> run(std::function<bool()> task); // Runs any task on the thread pool
+        bool usingIoUring() const; // Returns true if io_uring is being used for the IO
+
+    private:
+        struct Ring;
+
+        AsyncIo();
+        void post(std::function<void()> task); // Adds a task to the thread pool
+        void complete(const RequestPtr& request, bool status); // Finishes a request on the thread pool
+        void runWorker(); // Thread pool loop
+        void runRing(); // io_uring submission/completion loop
+
+        // Thread pool
+        std::vector<std::thread> workers;
+        std::mutex mutex;
+        std::condition_variable ready;
+        std::deque<std::function<void()>> tasks;
+        bool stopping{};
+
+        // io_uring backend (only used when available)
+        std::unique_ptr<Ring> ring;
+        std::thread ringThread;
+};
+
+}
+
+#endif
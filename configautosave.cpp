@@ -0,0 +1,98 @@
+// Copyright (C) 2014-2016 Eric Hebert (ayebear)
+// This code is licensed under MIT, see LICENSE.txt for details.
+
+#include "configautosave.h"
+#include "configfile.h"
+
+namespace cfg
+{
+
+AutosaveWorker::~AutosaveWorker()
+{
+    stop();
+}
+
+void AutosaveWorker::start(File& file, std::chrono::milliseconds quietPeriod)
+{
+    stop();
+    state = std::make_unique<State>();
+    // The revision is read here, so changes made before the thread runs are still saved
+    thread = std::thread(&AutosaveWorker::run, this, std::ref(file), quietPeriod, Option::getLatestRevision());
+}
+
+bool AutosaveWorker::stop()
+{
+    if (!state)
+        return false;
+    {
+        std::lock_guard<std::mutex> lock(state->mutex);
+        state->stopping = true;
+    }
+    state->changed.notify_one();
+    thread.join();
+    state.reset();
+    return true;
+}
+
+bool AutosaveWorker::isRunning() const
+{
+    return (state != nullptr);
+}
+
+void AutosaveWorker::notify()
+{
+    if (state)
+    {
+        {
+            std::lock_guard<std::mutex> lock(state->mutex);
+            ++state->changes;
+        }
+        state->changed.notify_one();
+    }
+}
+
+std::mutex& AutosaveWorker::getMutex()
+{
+    return fileMutex;
+}
+
+void AutosaveWorker::run(File& file, std::chrono::milliseconds quietPeriod, std::uint64_t seenRevision)
+{
+    std::unique_lock<std::mutex> lock(state->mutex);
+    unsigned long seen = 0; // The state is new, so any changes were made after starting
+
+    // Assigning to an Option& does not notify, but it always gives out a new revision
+    // Revisions of other files are counted too, which at worst checks this file for changes once more
+    auto hasChanged = [&]{ return state->changes != seen || Option::getLatestRevision() != seenRevision; };
+
+    while (!state->stopping)
+    {
+        // Sleep until something happens, or until the revisions need to be checked again
+        state->changed.wait_for(lock, quietPeriod, [&]{ return state->stopping || state->changes != seen; });
+        if (state->stopping)
+            break;
+        if (!hasChanged())
+            continue;
+
+        // Keep waiting until there are no more changes for the whole quiet period
+        do
+        {
+            seen = state->changes;
+            seenRevision = Option::getLatestRevision();
+            state->changed.wait_for(lock, quietPeriod, [&]{ return state->stopping || state->changes != seen; });
+        }
+        while (!state->stopping && hasChanged());
+        if (state->stopping)
+            break;
+
+        // Only writes if something actually changed
+        lock.unlock();
+        {
+            std::lock_guard<std::mutex> fileLock(fileMutex);
+            file.writeChanges();
+        }
+        lock.lock();
+    }
+}
+
+}
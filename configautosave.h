@@ -0,0 +1,61 @@
+// Copyright (C) 2014-2016 Eric Hebert (ayebear)
+// This code is licensed under MIT, see LICENSE.txt for details.
+
+#ifndef CFG_AUTOSAVE_H
+#define CFG_AUTOSAVE_H
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+namespace cfg
+{
+
+class File;
+
+/*
+Saves a file in the background once it has stopped changing for a while.
+Bursts of changes are combined into a single write, and nothing is written
+if none of the options actually changed. Changes made through references to
+options don't notify the worker, so it also checks the revision counter of the
+options once every quiet period.
+Saving reads every option (and creates the text of numbers set from code), so
+reading options from other threads also needs the mutex while the worker runs.
+Copying does not copy the running worker.
+*/
+class AutosaveWorker
+{
+    public:
+        AutosaveWorker() {}
+        AutosaveWorker(const AutosaveWorker&) {}
+        AutosaveWorker& operator=(const AutosaveWorker&) { return *this; }
+        ~AutosaveWorker();
+
+        void start(File& file, std::chrono::milliseconds quietPeriod); // Starts (or restarts) the worker thread
+        bool stop(); // Stops the worker thread, returns true if it was running
+        bool isRunning() const;
+        void notify(); // Tells the worker that the file may have changed
+        std::mutex& getMutex(); // Held by the worker while it is writing the file
+
+    private:
+        struct State
+        {
+            std::mutex mutex;
+            std::condition_variable changed;
+            unsigned long changes{}; // Incremented on every notification
+            bool stopping{};
+        };
+
+        void run(File& file, std::chrono::milliseconds quietPeriod, std::uint64_t seenRevision);
+
+        std::unique_ptr<State> state;
+        std::thread thread;
+        std::mutex fileMutex;
+};
+
+}
+
+#endif
@@ -0,0 +1,167 @@
+// Copyright (C) 2014-2016 Eric Hebert (ayebear)
+// This code is licensed under MIT, see LICENSE.txt for details.
+
+#include "configconcurrent.h"
+#include <utility>
+
+namespace cfg
+{
+
+ConcurrentFile::ConcurrentFile(int flags)
+{
+    file.setFlags(flags);
+}
+
+bool ConcurrentFile::loadFromFile(const std::string& filename)
+{
+    std::unique_lock<std::shared_mutex> mapLock(mapMutex);
+    bool status = file.loadFromFile(filename);
+    resetMutexes();
+    return status;
+}
+
+bool ConcurrentFile::loadFromString(const std::string& str)
+{
+    std::unique_lock<std::shared_mutex> mapLock(mapMutex);
+    bool status = file.loadFromString(str);
+    resetMutexes();
+    return status;
+}
+
+bool ConcurrentFile::writeToFile(std::string filename) const
+{
+    // Saving changes what the file remembers about the last save, so only one thread can do it at a time
+    std::unique_lock<std::shared_mutex> mapLock(mapMutex);
+    return file.writeToFile(filename);
+}
+
+void ConcurrentFile::writeToString(std::string& str) const
+{
+    // Every section is locked at once, so the output is from one point in time
+    // The locks are always taken in the same order, and writers only hold one, so this can't deadlock
+    std::shared_lock<std::shared_mutex> mapLock(mapMutex);
+    std::vector<std::shared_lock<SectionMutex>> sectionLocks;
+    sectionLocks.reserve(sectionMutexes.size());
+    for (const auto& sectionMutex: sectionMutexes)
+        sectionLocks.emplace_back(*sectionMutex.second);
+    file.writeToString(str);
+}
+
+std::string ConcurrentFile::buildString() const
+{
+    std::string str;
+    writeToString(str);
+    return str;
+}
+
+std::string ConcurrentFile::get(std::string_view name, std::string_view section, const char* defaultValue) const
+{
+    return get<std::string>(name, section, defaultValue);
+}
+
+bool ConcurrentFile::optionExists(std::string_view name, std::string_view section) const
+{
+    bool exists = false;
+    read(section, [&](const File::Section& found){ exists = (found.find(name) != found.end()); });
+    return exists;
+}
+
+bool ConcurrentFile::eraseOption(std::string_view name, std::string_view section)
+{
+    std::shared_lock<std::shared_mutex> mapLock(mapMutex);
+    SectionMutex* sectionMutex = findMutex(section);
+    if (!sectionMutex)
+        return false;
+    std::unique_lock<SectionMutex> sectionLock(*sectionMutex);
+    File::Section& found = file.options.find(section)->second;
+    auto optionFound = found.find(name);
+    if (optionFound == found.end())
+        return false;
+    found.erase(optionFound);
+    file.notifyChange();
+    return true;
+}
+
+bool ConcurrentFile::sectionExists(std::string_view section) const
+{
+    std::shared_lock<std::shared_mutex> mapLock(mapMutex);
+    return (findMutex(section) != nullptr);
+}
+
+bool ConcurrentFile::eraseSection(std::string_view section)
+{
+    std::unique_lock<std::shared_mutex> mapLock(mapMutex);
+    auto mutexFound = sectionMutexes.find(section);
+    if (mutexFound == sectionMutexes.end())
+        return false;
+    sectionMutexes.erase(mutexFound);
+    return file.eraseSection(std::string(section));
+}
+
+void ConcurrentFile::clear()
+{
+    std::unique_lock<std::shared_mutex> mapLock(mapMutex);
+    file.clear();
+    sectionMutexes.clear();
+}
+
+File& ConcurrentFile::getFile()
+{
+    return file;
+}
+
+ConcurrentFile::SectionMutex* ConcurrentFile::findMutex(std::string_view section) const
+{
+    auto mutexFound = sectionMutexes.find(section);
+    return (mutexFound != sectionMutexes.end() ? mutexFound->second.get() : nullptr);
+}
+
+File::Section& ConcurrentFile::addSection(const std::string& section)
+{
+    auto& sectionMutex = sectionMutexes[section];
+    if (!sectionMutex)
+        sectionMutex = std::make_unique<SectionMutex>();
+    return file.findOrAddSection(section);
+}
+
+void ConcurrentFile::resetMutexes()
+{
+    // Locks of sections that still exist are kept, since nothing can be holding them right now anyway
+    auto mutexIt = sectionMutexes.begin();
+    for (const auto& section: file.options)
+    {
+        while (mutexIt != sectionMutexes.end() && mutexIt->first < section.first)
+            mutexIt = sectionMutexes.erase(mutexIt);
+        if (mutexIt != sectionMutexes.end() && mutexIt->first == section.first)
+            ++mutexIt;
+        else
+            sectionMutexes.emplace_hint(mutexIt, section.first, std::make_unique<SectionMutex>());
+    }
+    sectionMutexes.erase(mutexIt, sectionMutexes.end());
+
+    // Numbers that were set from code create their text later, which readers can't do
+    for (auto& section: file.options)
+    {
+        for (auto& option: section.second)
+            finishWrite(option.second);
+    }
+}
+
+void ConcurrentFile::finishWrite(Option& option)
+{
+    AccessCounter::Pause pause;
+    option.toString();
+    if (option.isNumericArray())
+    {
+        // Readers iterate over read-only elements, so those (and their text) are created here
+        for (auto it = std::as_const(option).cbegin(); it != option.cend(); ++it)
+            it->toString();
+    }
+    else
+    {
+        for (auto& element: option)
+            finishWrite(element);
+    }
+}
+
+}
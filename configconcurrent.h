@@ -0,0 +1,164 @@
+// Copyright (C) 2014-2016 Eric Hebert (ayebear)
+// This code is licensed under MIT, see LICENSE.txt for details.
+
+#ifndef CFG_CONCURRENT_H
+#define CFG_CONCURRENT_H
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "configfile.h"
+
+namespace cfg
+{
+
+/*
+A file that many threads can read and change at the same time.
+Each section has its own lock, so threads using different sections do not wait for each other.
+Adding/erasing sections, loading, and clearing lock everything.
+Writing to a string/file locks every section for reading, so it sees one consistent version.
+
+Callbacks passed to read() get a const section, and should only use const functions of the options.
+Change callbacks and interpolation of the file are only used when loading.
+The autosave worker of the file does not use these locks, so save with writeToFile() instead.
+*/
+class ConcurrentFile
+{
+    public:
+        ConcurrentFile(int flags = File::DefaultFlags);
+
+        // Loading/saving
+        bool loadFromFile(const std::string& filename);
+        bool loadFromString(const std::string& str); // Returns false if a parse limit was reached
+        bool writeToFile(std::string filename = "") const;
+        void writeToString(std::string& str) const;
+        std::string buildString() const;
+
+        // Reading/changing a whole section while it is locked
+        template <typename Function>
+        bool read(std::string_view section, Function function) const; // Calls function(const File::Section&), returns false if the section does not exist
+        template <typename Function>
+        void modify(const std::string& section, Function function); // Calls function(File::Section&), adding the section if needed
+
+        // Options
+        template <typename Type>
+        bool set(const std::string& name, const std::string& section, const Type& value); // Sets an option, returns false if it was out of range
+        template <typename Type>
+        Type get(std::string_view name, std::string_view section, const Type& defaultValue) const; // Returns the value of an option, or the default value
+        std::string get(std::string_view name, std::string_view section, const char* defaultValue) const;
+        bool optionExists(std::string_view name, std::string_view section) const;
+        bool eraseOption(std::string_view name, std::string_view section);
+
+        // Sections
+        bool sectionExists(std::string_view section) const;
+        bool eraseSection(std::string_view section);
+        void clear();
+
+        File& getFile(); // Returns the file without any locking, only use it while no other threads are
+
+    private:
+        using SectionMutex = std::shared_mutex;
+
+        SectionMutex* findMutex(std::string_view section) const; // The map lock must be held
+        File::Section& addSection(const std::string& section); // The map lock must be held exclusively
+        void resetMutexes(); // Makes a lock for every section, the map lock must be held exclusively
+        static void finishWrite(Option& option); // Converts anything that readers would have to change
+
+        File file;
+        mutable std::shared_mutex mapMutex; // Protects which sections exist
+        std::map<std::string, std::unique_ptr<SectionMutex>, std::less<>> sectionMutexes; // One for each section
+};
+
+template <typename Function>
+bool ConcurrentFile::read(std::string_view section, Function function) const
+{
+    std::shared_lock<std::shared_mutex> mapLock(mapMutex);
+    SectionMutex* sectionMutex = findMutex(section);
+    if (!sectionMutex)
+        return false;
+    std::shared_lock<SectionMutex> sectionLock(*sectionMutex);
+    function(static_cast<const File::Section&>(file.options.find(section)->second));
+    return true;
+}
+
+template <typename Function>
+void ConcurrentFile::modify(const std::string& section, Function function)
+{
+    {
+        std::shared_lock<std::shared_mutex> mapLock(mapMutex);
+        SectionMutex* sectionMutex = findMutex(section);
+        if (sectionMutex)
+        {
+            std::unique_lock<SectionMutex> sectionLock(*sectionMutex);
+            File::Section& found = file.options.find(section)->second;
+            function(found);
+            for (auto& option: found)
+            {
+                file.telemetry.attach(option.second);
+                finishWrite(option.second);
+            }
+            file.notifyChange();
+            return;
+        }
+    }
+
+    // The section needs to be added, which changes the map
+    std::unique_lock<std::shared_mutex> mapLock(mapMutex);
+    File::Section& added = addSection(section);
+    function(added);
+    for (auto& option: added)
+    {
+        file.telemetry.attach(option.second);
+        finishWrite(option.second);
+    }
+    file.notifyChange();
+}
+
+template <typename Type>
+bool ConcurrentFile::set(const std::string& name, const std::string& section, const Type& value)
+{
+    bool status = false;
+    auto setOption = [&](File::Section& found)
+    {
+        Option& option = found[name];
+        file.telemetry.attach(option);
+        status = (option = value);
+        finishWrite(option);
+    };
+    {
+        std::shared_lock<std::shared_mutex> mapLock(mapMutex);
+        SectionMutex* sectionMutex = findMutex(section);
+        if (sectionMutex)
+        {
+            std::unique_lock<SectionMutex> sectionLock(*sectionMutex);
+            setOption(file.options.find(section)->second);
+            file.notifyChange();
+            return status;
+        }
+    }
+    std::unique_lock<std::shared_mutex> mapLock(mapMutex);
+    setOption(addSection(section));
+    file.notifyChange();
+    return status;
+}
+
+template <typename Type>
+Type ConcurrentFile::get(std::string_view name, std::string_view section, const Type& defaultValue) const
+{
+    Type value = defaultValue;
+    read(section, [&](const File::Section& found)
+    {
+        auto optionFound = found.find(name);
+        if (optionFound != found.end())
+            optionFound->second.get(value);
+    });
+    return value;
+}
+
+}
+
+#endif
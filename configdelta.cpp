@@ -0,0 +1,331 @@
+// Copyright (C) 2014-2016 Eric Hebert (ayebear)
+// This code is licensed under MIT, see LICENSE.txt for details.
+
+#include "configdelta.h"
+#include <algorithm>
+#include <iostream>
+#include "configfile.h"
+
+namespace cfg
+{
+
+namespace
+{
+
+std::string_view trimSpaces(std::string_view str)
+{
+    while (!str.empty() && std::isspace(static_cast<unsigned char>(str.front())))
+        str.remove_prefix(1);
+    while (!str.empty() && std::isspace(static_cast<unsigned char>(str.back())))
+        str.remove_suffix(1);
+    return str;
+}
+
+}
+
+void Delta::build(const File& source, const File& target, std::string& delta)
+{
+    AccessCounter::Pause pause; // Comparing every option is not a read by the program
+    // Both maps are sorted, so they are walked together like a merge
+    auto sourceSection = source.options.begin();
+    auto targetSection = target.options.begin();
+    while (sourceSection != source.options.end() || targetSection != target.options.end())
+    {
+        int order = 0;
+        if (sourceSection == source.options.end())
+            order = 1;
+        else if (targetSection == target.options.end())
+            order = -1;
+        else
+            order = sourceSection->first.compare(targetSection->first);
+
+        if (order < 0)
+        {
+            delta += "-[" + sourceSection->first + "]\n";
+            ++sourceSection;
+            continue;
+        }
+
+        // The section header is removed again if nothing in the section changed
+        size_t headerPos = delta.size();
+        delta += '[' + targetSection->first + "]\n";
+        size_t bodyPos = delta.size();
+        const File::Section& targetOptions = targetSection->second;
+        auto targetOption = targetOptions.begin();
+        if (order == 0)
+        {
+            const File::Section& sourceOptions = sourceSection->second;
+            auto sourceOption = sourceOptions.begin();
+            while (sourceOption != sourceOptions.end() || targetOption != targetOptions.end())
+            {
+                int optionOrder = 0;
+                if (sourceOption == sourceOptions.end())
+                    optionOrder = 1;
+                else if (targetOption == targetOptions.end())
+                    optionOrder = -1;
+                else
+                    optionOrder = sourceOption->first.compare(targetOption->first);
+
+                if (optionOrder < 0)
+                    delta += '-' + sourceOption->first + '\n';
+                else if (optionOrder > 0)
+                {
+                    delta += targetOption->first + " = ";
+                    appendValue(targetOption->second, delta);
+                    delta += '\n';
+                }
+                else
+                    buildOption(sourceOption->second, targetOption->second, targetOption->first, delta);
+                if (optionOrder <= 0)
+                    ++sourceOption;
+                if (optionOrder >= 0)
+                    ++targetOption;
+            }
+            if (delta.size() == bodyPos)
+                delta.resize(headerPos);
+            ++sourceSection;
+        }
+        else
+        {
+            // New sections are always written, even if they are empty
+            for (; targetOption != targetOptions.end(); ++targetOption)
+            {
+                delta += targetOption->first + " = ";
+                appendValue(targetOption->second, delta);
+                delta += '\n';
+            }
+        }
+        ++targetSection;
+    }
+}
+
+bool Delta::apply(File& file, std::string_view delta)
+{
+    std::string section;
+    bool status = true;
+    AccessCounter::Pause pause; // Finding the array elements to change is not a read
+    for (auto line: strlib::splitView(delta, "\n"))
+    {
+        if (!line.empty() && !applyLine(file, line, section))
+        {
+            if (file.flags & File::Verbose)
+                std::cout << "Error applying change: \"" << line << "\"\n";
+            status = false;
+            break;
+        }
+    }
+    file.resolveInterpolation();
+    file.attachTelemetry();
+    file.notifyChange();
+    return status;
+}
+
+void Delta::buildOption(const Option& source, const Option& target, const std::string& path, std::string& delta)
+{
+    if (equals(source, target))
+        return;
+    if (source.size() == 0 || target.size() == 0)
+    {
+        delta += path + " = ";
+        appendValue(target, delta);
+        delta += '\n';
+        return;
+    }
+
+    // Both are arrays, so only the elements that changed are written
+    unsigned sourceSize = source.size();
+    unsigned targetSize = target.size();
+    unsigned commonSize = std::min(sourceSize, targetSize);
+    Option sourceNumber;
+    Option targetNumber;
+    for (unsigned i = 0; i < commonSize; ++i)
+    {
+        buildOption(getElement(source, i, sourceNumber), getElement(target, i, targetNumber),
+            path + '[' + std::to_string(i) + ']', delta);
+    }
+    if (sourceSize > targetSize)
+        delta += path + " -= " + std::to_string(sourceSize - targetSize) + '\n';
+    for (unsigned i = commonSize; i < targetSize; ++i)
+    {
+        delta += path + " += ";
+        appendValue(getElement(target, i, targetNumber), delta);
+        delta += '\n';
+    }
+}
+
+const Option& Delta::getElement(const Option& array, unsigned pos, Option& number)
+{
+    // Iterating over a numeric array would create its elements, so the number is copied into an option instead
+    if (!array.isNumericArray())
+        return array.cbegin()[pos];
+    double decimal = array.asDoubles()[pos];
+    long integer = array.asLongs()[pos];
+    if (decimal == static_cast<double>(integer))
+        number = integer;
+    else
+        number = decimal;
+    return number;
+}
+
+bool Delta::equals(const Option& source, const Option& target)
+{
+    if (source.size() != target.size())
+        return false;
+    if (source.size() > 0)
+        return (source.buildArrayString() == target.buildArrayString());
+    if (source.sharesText(target))
+        return true;
+    return (source.hasQuotes() == target.hasQuotes() && source.toString() == target.toString());
+}
+
+void Delta::appendValue(const Option& option, std::string& str)
+{
+    if (option.size() == 0)
+    {
+        str += option.toStringWithQuotes(true);
+        return;
+    }
+
+    // Arrays are written the same way as in files, but without the new lines and indentation
+    // Strings can't have new lines or tabs in them, since those are written as escape codes
+    std::string arrayStr = option.buildArrayString("", true);
+    for (size_t i = 0; i < arrayStr.size(); ++i)
+    {
+        if (arrayStr[i] == '\n')
+        {
+            while (i + 1 < arrayStr.size() && arrayStr[i + 1] == '\t')
+                ++i;
+            if (str.back() == ',')
+                str += ' ';
+        }
+        else
+            str += arrayStr[i];
+    }
+}
+
+bool Delta::applyLine(File& file, std::string_view line, std::string& section)
+{
+    if (line.front() == '[' && line.back() == ']')
+    {
+        section.assign(line.substr(1, line.size() - 2));
+        file.findOrAddSection(section);
+        return true;
+    }
+
+    // Erasing something that does not exist is fine, since the result is the same
+    size_t equalPos = line.find('=');
+    if (equalPos == std::string_view::npos)
+    {
+        if (line.size() < 2 || line.front() != '-')
+            return false;
+        if (line[1] == '[' && line.back() == ']')
+            file.eraseSection(std::string(line.substr(2, line.size() - 3)));
+        else
+            file.eraseOption(std::string(line.substr(1)), section);
+        return true;
+    }
+
+    // Names can't have "=" in them, so the first one is always the operator
+    char op = '=';
+    size_t nameEnd = equalPos;
+    if (equalPos >= 2 && (line[equalPos - 1] == '+' || line[equalPos - 1] == '-') && line[equalPos - 2] == ' ')
+    {
+        op = line[equalPos - 1];
+        nameEnd = equalPos - 1;
+    }
+    std::string_view name = trimSpaces(line.substr(0, nameEnd));
+    std::string_view value = trimSpaces(line.substr(equalPos + 1));
+    std::vector<unsigned> path;
+    parsePath(name, path);
+    if (name.empty())
+        return false;
+
+    Option parsed;
+    if (op != '-' && !parseValue(file, value, parsed))
+        return false;
+    std::string nameStr(name);
+    if (op == '=' && path.empty())
+    {
+        file.assignOption(nameStr, section, parsed);
+        return true;
+    }
+
+    // Changing an array needs the option to already exist
+    File::Section* sectionFound = file.findSection(section);
+    if (!sectionFound)
+        return false;
+    auto optionFound = sectionFound->find(nameStr);
+    if (optionFound == sectionFound->end())
+        return false;
+    Option& option = optionFound->second;
+    bool watched = file.isWatched(nameStr, section);
+    Option oldValue;
+    if (watched)
+        oldValue = option;
+
+    Option* element = &option;
+    for (unsigned index: path)
+    {
+        if (index >= element->size())
+            return false;
+        element = &(*element)[index];
+    }
+    if (op == '=')
+        *element = parsed;
+    else if (op == '+')
+    {
+        // Plain numbers keep numeric arrays contiguous
+        if (parsed.size() == 0 && !parsed.hasQuotes())
+            file.addArrayElement(*element, value);
+        else
+            element->push(parsed);
+    }
+    else
+    {
+        unsigned count = 0;
+        if (!strlib::fromChars(value, count) || count > element->size())
+            return false;
+        for (unsigned i = 0; i < count; ++i)
+            element->pop();
+    }
+
+    if (watched)
+        file.callWatchers(nameStr, section, oldValue, option);
+    if (file.flags & File::Interpolate)
+        file.updateInterpolation(nameStr, section, option);
+    return true;
+}
+
+bool Delta::parseValue(File& file, std::string_view value, Option& option)
+{
+    if (value.empty() || value.front() != '{')
+    {
+        file.setOption(option, std::string(value), true);
+        return true;
+    }
+
+    // Arrays are parsed by a separate file, so the file being changed is not in the middle of an array
+    File arrayFile;
+    arrayFile.setFlags(File::Escapes); // Deltas always use escape codes, so values stay on one line
+    arrayFile.parseOptionLine("array = " + std::string(value), "");
+    if (!arrayFile.arrayStack.empty())
+        return false;
+    option = arrayFile.options[""]["array"];
+    return true;
+}
+
+void Delta::parsePath(std::string_view& name, std::vector<unsigned>& path)
+{
+    // Indexes are read from the end, since names can have brackets in them too
+    while (name.size() >= 3 && name.back() == ']')
+    {
+        size_t open = name.rfind('[');
+        unsigned index = 0;
+        if (open == std::string_view::npos || !strlib::fromChars(name.substr(open + 1, name.size() - open - 2), index))
+            break;
+        path.insert(path.begin(), index);
+        name.remove_suffix(name.size() - open);
+    }
+}
+
+}
@@ -0,0 +1,48 @@
+// Copyright (C) 2014-2016 Eric Hebert (ayebear)
+// This code is licensed under MIT, see LICENSE.txt for details.
+
+#ifndef CFG_DELTA_H
+#define CFG_DELTA_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace cfg
+{
+
+class File;
+class Option;
+
+/*
+Finds the differences between two files, and writes them as changes that can be applied to another file.
+Each change is one line, in a format similar to config files:
+    [Section]           The following changes are in this section (which is added if it does not exist)
+    -[Section]          Erases a section
+    name = value        Sets an option (arrays are written on one line)
+    -name               Erases an option
+    name[1] = value     Sets an element of an array (more indexes are used for arrays inside of arrays)
+    name[1] += value    Adds an element to the end of an array
+    name[1] -= 2        Removes elements from the end of an array
+Only the options and array elements that changed are written. Interpolated values are written
+as their resolved text, so they will not follow the options they used in the file the delta is applied to.
+*/
+class Delta
+{
+    public:
+        static void build(const File& source, const File& target, std::string& delta); // Appends the changes from source to target
+        static bool apply(File& file, std::string_view delta); // Returns false if a line could not be applied (the lines before it are kept)
+
+    private:
+        static void buildOption(const Option& source, const Option& target, const std::string& path, std::string& delta);
+        static bool equals(const Option& source, const Option& target); // Returns true if both would be written the same way
+        static const Option& getElement(const Option& array, unsigned pos, Option& number); // Returns an element, without changing the array
+        static void appendValue(const Option& option, std::string& str); // Writes a value on one line
+        static bool applyLine(File& file, std::string_view line, std::string& section);
+        static bool parseValue(File& file, std::string_view value, Option& option); // Sets an option from a value written by appendValue
+        static void parsePath(std::string_view& name, std::vector<unsigned>& path); // Removes the array indexes from the end of a name
+};
+
+}
+
+#endif
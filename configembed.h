@@ -0,0 +1,51 @@
+// Copyright (C) 2014-2016 Eric Hebert (ayebear)
+// This code is licensed under MIT, see LICENSE.txt for details.
+
+#ifndef CFG_EMBED_H
+#define CFG_EMBED_H
+
+namespace cfg
+{
+
+/*
+Read-only options generated at build time by cfgembed (see cfg_embed in CMakeLists.txt).
+Everything is statically initialized, so nothing is parsed or allocated until it is added to a File.
+*/
+
+// The value of an option, with every type already converted
+struct EmbeddedValue
+{
+    const char* text;
+    unsigned textSize;
+    long integer;
+    double decimal;
+    bool boolean;
+    bool quotes;
+    unsigned elementCount; // Number of array elements (zero if it is not an array)
+    const EmbeddedValue* elements;
+};
+
+struct EmbeddedOption
+{
+    const char* name;
+    unsigned nameSize;
+    EmbeddedValue value;
+};
+
+struct EmbeddedSection
+{
+    const char* name;
+    unsigned nameSize;
+    unsigned optionCount;
+    const EmbeddedOption* options; // Sorted by name
+};
+
+struct EmbeddedConfig
+{
+    unsigned sectionCount;
+    const EmbeddedSection* sections; // Sorted by name
+};
+
+}
+
+#endif
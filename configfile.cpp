@@ -2,9 +2,14 @@
 // This code is licensed under MIT, see LICENSE.txt for details.
 
 #include "configfile.h"
+#include <algorithm>
+#include <cmath>
 #include <fstream>
 #include <iostream>
+#include <iterator>
+#include <thread>
 #include "strlib.h"
+#include "configasync.h"
 
 namespace cfg
 {
@@ -35,49 +40,189 @@ File::File(const std::string& filename, const ConfigMap& defaultOptions, int new
 
 File::~File()
 {
+    stopAutosave();
     if (flags & Autosave)
-        writeToFile();
+        writeChanges();
+    options.clear(); // The options update the text cache when they are destroyed, so they go first
 }
 
 bool File::loadFromFile(const std::string& filename)
 {
     configFilename = filename;
-    std::vector<std::string> lines;
-    fileIoSuccessful = strlib::readLinesFromFile(configFilename, lines);
-    if (fileIoSuccessful)
-        parseLines(lines);
-    else if (flags & Verbose)
-        std::cout << "Error loading \"" << configFilename << "\"\n";
-    return fileIoSuccessful;
+    std::string source;
+    // One extra byte is read, so a file larger than the limit is still found without reading all of it
+    bool status = strlib::readStringFromFile(configFilename, source, (parseLimits.maxBytes ? parseLimits.maxBytes + 1 : 0));
+    return finishLoading(status, source);
 }
 
-void File::loadFromString(const std::string& str)
+bool File::loadFromString(const std::string& str)
 {
-    auto lines = strlib::getLinesFromString(str);
-    parseLines(lines);
+    bool status = parseString(str);
+    notifyChange();
+    return status;
+}
+
+void File::loadFromEmbedded(const EmbeddedConfig& config)
+{
+    for (unsigned s = 0; s < config.sectionCount; ++s)
+    {
+        const EmbeddedSection& embeddedSection = config.sections[s];
+        Section& section = findOrAddSection(std::string_view(embeddedSection.name, embeddedSection.nameSize));
+        for (unsigned o = 0; o < embeddedSection.optionCount; ++o)
+        {
+            // The options are sorted, so new ones are always added at the end
+            const EmbeddedOption& embeddedOption = embeddedSection.options[o];
+            std::string_view name(embeddedOption.name, embeddedOption.nameSize);
+            size_t size = section.size();
+            auto optionFound = section.try_emplace(section.end(), std::string(name), embeddedOption.value);
+            if (section.size() == size || (flags & Interpolate))
+            {
+                std::string sectionName(embeddedSection.name, embeddedSection.nameSize);
+                if (section.size() == size)
+                    assignOption(optionFound->first, sectionName, Option(embeddedOption.value));
+                else
+                    updateInterpolation(optionFound->first, sectionName, optionFound->second);
+            }
+        }
+    }
+    resolveInterpolation();
+    attachTelemetry();
+    notifyChange();
+}
+
+std::future<bool> File::loadFromFileAsync(const std::string& filename)
+{
+    return std::move(loadFromFilesAsync({{this, filename}}).front());
+}
+
+std::vector<std::future<bool>> File::loadFromFilesAsync(const std::vector<std::pair<File*, std::string>>& files)
+{
+    std::vector<AsyncIo::RequestPtr> requests;
+    requests.reserve(files.size());
+    for (const auto& file: files)
+    {
+        File* filePtr = file.first;
+        filePtr->configFilename = file.second;
+        requests.push_back(AsyncIo::makeRead(file.second,
+            [filePtr](bool status, std::string& data){ return filePtr->finishLoading(status, data); }));
+        if (filePtr->parseLimits.maxBytes)
+            requests.back()->maxBytes = filePtr->parseLimits.maxBytes + 1;
+    }
+    return AsyncIo::getInstance().submit(requests);
+}
+
+std::future<bool> File::writeToFileAsync(std::string filename) const
+{
+    if (filename.empty())
+        filename = configFilename;
+    if ((flags & PreserveLayout) && !layout.empty())
+    {
+        // Patching needs the file to stay the same until it is done
+        return AsyncIo::getInstance().run([this, filename]{ return writeToFile(filename); });
+    }
+    return AsyncIo::getInstance().submit(makeWriteRequest(filename));
+}
+
+std::vector<std::future<bool>> File::writeToFilesAsync(const std::vector<const File*>& files)
+{
+    std::vector<std::future<bool>> futures(files.size());
+    std::vector<AsyncIo::RequestPtr> requests;
+    std::vector<size_t> requestIndices;
+    for (size_t i = 0; i < files.size(); ++i)
+    {
+        const File* file = files[i];
+        if ((file->flags & PreserveLayout) && !file->layout.empty())
+            futures[i] = file->writeToFileAsync();
+        else
+        {
+            requests.push_back(file->makeWriteRequest(file->configFilename));
+            requestIndices.push_back(i);
+        }
+    }
+
+    // All of the regular writes are submitted together
+    auto batchFutures = AsyncIo::getInstance().submit(requests);
+    for (size_t i = 0; i < batchFutures.size(); ++i)
+        futures[requestIndices[i]] = std::move(batchFutures[i]);
+    return futures;
 }
 
 bool File::writeToFile(std::string filename) const
 {
     if (filename.empty())
         filename = configFilename;
-    // Write the std::string to the output file
-    fileIoSuccessful = strlib::writeStringToFile(filename, buildString());
+    if ((flags & PreserveLayout) && !layout.empty())
+    {
+        // Only write what changed since the last load/save
+        fileIoSuccessful = layout.write(*this, filename, filename == configFilename);
+    }
+    else
+    {
+        // Write the std::string to the output file
+        fileIoSuccessful = strlib::writeStringToFile(filename, buildString());
+    }
     if (!fileIoSuccessful && (flags & Verbose))
         std::cout << "Error writing \"" << configFilename << "\"\n";
+    else if (fileIoSuccessful && filename == configFilename)
+        markClean();
     return fileIoSuccessful;
 }
 
 void File::writeToString(std::string& str) const
 {
-    for (const auto& section: options) // Go through all of the sections
+    std::lock_guard<std::mutex> lock(textCache.mutex);
+
+    // Reuse the text of unchanged sections, the rest are serialized again
+    // The old cache is emptied into the new one, so erased sections are dropped
+    decltype(textCache.sections) sections;
+    std::vector<std::pair<const ConfigMap::value_type*, SectionText*>> changed;
+    size_t changedOptions = 0;
+    for (const auto& section: options)
+    {
+        // The cache entries are moved as nodes, so the options can keep pointing to them
+        auto node = textCache.sections.extract(section.first);
+        auto cachedFound = (node.empty() ? sections.emplace_hint(sections.end(), section.first, SectionText()) : sections.insert(sections.end(), std::move(node)));
+        SectionText& cached = cachedFound->second;
+        if (cached.text.empty() || cached.latest != cached.revision || cached.size != section.second.size())
+        {
+            cached.revision = cached.latest = Option::nextRevision();
+            cached.size = section.second.size();
+            for (const auto& o: section.second)
+                o.second.setParentRevision(&cached.latest);
+            changed.emplace_back(&section, &cached);
+            changedOptions += section.second.size();
+        }
+    }
+    textCache.sections.swap(sections);
+
+    // Large changes are split between threads, since each section can be serialized independently
+    unsigned threads = std::min<size_t>(std::thread::hardware_concurrency(), changed.size());
+    if ((flags & ParallelWrite) && changedOptions >= 4096 && threads >= 2)
     {
-        if (!section.first.empty())
-            str += '[' + section.first + "]\n"; // Add the section line if it is not blank
-        for (const auto& o: section.second) // Go through all of the options in this section
-            str += o.first + " = " + o.second.buildArrayString() + '\n';
-        str += '\n';
+        std::vector<std::future<void>> tasks;
+        for (unsigned t = 0; t < threads; ++t)
+        {
+            tasks.push_back(std::async(std::launch::async, [this, &changed, t, threads]
+            {
+                for (size_t i = t; i < changed.size(); i += threads)
+                    writeSection(changed[i].first->first, changed[i].first->second, changed[i].second->text);
+            }));
+        }
+        for (auto& task: tasks)
+            task.get();
     }
+    else
+    {
+        for (auto& section: changed)
+            writeSection(section.first->first, section.first->second, section.second->text);
+    }
+
+    size_t size = str.size();
+    for (const auto& section: textCache.sections)
+        size += section.second.text.size();
+    str.reserve(size);
+    for (const auto& section: textCache.sections)
+        str += section.second.text;
     if (!str.empty() && str.back() == '\n')
         str.pop_back(); // Strip the extra new line at the end
 }
@@ -112,20 +257,38 @@ void File::setFlags(int newFlags)
     flags = newFlags;
 }
 
+void File::setParseLimits(const ParseLimits& limits)
+{
+    parseLimits = limits;
+}
+
+const File::ParseLimits& File::getParseLimits() const
+{
+    return parseLimits;
+}
+
+const std::string& File::getParseError() const
+{
+    return parseError;
+}
+
 Option& File::operator()(const std::string& name, const std::string& section)
 {
-    return options[section][name];
+    notifyChange();
+    Option& option = findOrAddSection(section)[name];
+    telemetry.attach(option);
+    return option;
 }
 
 Option& File::operator()(const std::string& name)
 {
-    return options[currentSection][name];
+    return (*this)(name, currentSection);
 }
 
 bool File::optionExists(const std::string& name, const std::string& section) const
 {
-    auto sectionFound = options.find(section);
-    return (sectionFound != options.end() && sectionFound->second.find(name) != sectionFound->second.end());
+    const Section* sectionFound = findSection(section);
+    return (sectionFound && sectionFound->find(name) != sectionFound->end());
 }
 
 bool File::optionExists(const std::string& name) const
@@ -133,9 +296,31 @@ bool File::optionExists(const std::string& name) const
     return optionExists(name, currentSection);
 }
 
+const Option* File::find(std::string_view name, std::string_view section) const
+{
+    const Section* sectionFound = findSection(section);
+    if (!sectionFound)
+        return nullptr;
+    auto optionFound = sectionFound->find(name);
+    return (optionFound != sectionFound->end() ? &optionFound->second : nullptr);
+}
+
+const Option* File::find(std::string_view name) const
+{
+    return find(name, currentSection);
+}
+
+std::string File::get(std::string_view name, std::string_view section, const char* defaultValue) const
+{
+    const Option* option = find(name, section);
+    return (option ? option->toString() : defaultValue);
+}
+
 void File::setDefaultOptions(const ConfigMap& defaultOptions)
 {
     options.insert(defaultOptions.begin(), defaultOptions.end());
+    attachTelemetry();
+    notifyChange();
 }
 
 void File::useSection(const std::string& section)
@@ -145,6 +330,7 @@ void File::useSection(const std::string& section)
 
 File::ConfigMap::iterator File::begin()
 {
+    notifyChange();
     return options.begin();
 }
 
@@ -155,17 +341,19 @@ File::ConfigMap::iterator File::end()
 
 File::Section& File::getSection(const std::string& section)
 {
-    return options[section];
+    notifyChange();
+    return findOrAddSection(section);
 }
 
 File::Section& File::getSection()
 {
-    return options[currentSection];
+    notifyChange();
+    return findOrAddSection(currentSection);
 }
 
 bool File::sectionExists(const std::string& section) const
 {
-    return (options.find(section) != options.end());
+    return (findSection(section) != nullptr);
 }
 
 bool File::sectionExists() const
@@ -173,12 +361,33 @@ bool File::sectionExists() const
     return sectionExists(currentSection);
 }
 
+size_t File::countWithPrefix(std::string_view prefix, std::string_view section) const
+{
+    const Section* sectionFound = findSection(section);
+    if (!sectionFound)
+        return 0;
+    auto range = findPrefix(*sectionFound, prefix);
+    return std::distance(range.first, range.second);
+}
+
+size_t File::countSectionsWithPrefix(std::string_view prefix) const
+{
+    auto range = findPrefix(options, prefix);
+    return std::distance(range.first, range.second);
+}
+
 bool File::eraseOption(const std::string& name, const std::string& section)
 {
     bool status = false;
-    auto sectionFound = options.find(section);
-    if (sectionFound != options.end()) // If the section exists
-        status = (sectionFound->second.erase(name) > 0); // Erase the option
+    Section* sectionFound = findSection(section);
+    if (sectionFound) // If the section exists
+        status = (sectionFound->erase(name) > 0); // Erase the option
+    if (status && (flags & Interpolate))
+    {
+        interpolation.erase(name, section);
+        resolveInterpolation();
+    }
+    notifyChange();
     return status;
 }
 
@@ -189,7 +398,17 @@ bool File::eraseOption(const std::string& name)
 
 bool File::eraseSection(const std::string& section)
 {
-    return (options.erase(section) > 0);
+    notifyChange();
+    const Section* sectionFound = findSection(section);
+    if (sectionFound && (flags & Interpolate))
+    {
+        for (const auto& option: *sectionFound)
+            interpolation.erase(option.first, section);
+    }
+    sectionTree.unlink(section);
+    bool status = (options.erase(section) > 0);
+    resolveInterpolation();
+    return status;
 }
 
 bool File::eraseSection()
@@ -199,18 +418,208 @@ bool File::eraseSection()
 
 void File::clear()
 {
+    sectionTree.unlinkAll();
+    interpolation.clear();
     options.clear();
+    notifyChange();
+}
+
+void File::enableTelemetry(unsigned sampleInterval)
+{
+    if (!telemetry.isEnabled())
+    {
+        telemetry.enable(sampleInterval);
+        attachTelemetry();
+    }
+}
+
+void File::disableTelemetry()
+{
+    for (auto& section: options)
+    {
+        for (auto& option: section.second)
+            option.second.setCounter(nullptr);
+    }
+    telemetry.disable();
+}
+
+TelemetryReport File::getTelemetryReport() const
+{
+    TelemetryReport report;
+    for (const auto& section: options)
+    {
+        TelemetryReport::SectionStats sectionStats;
+        sectionStats.section = section.first;
+        for (const auto& option: section.second)
+        {
+            const AccessCounter* counter = option.second.getCounter();
+            if (!counter)
+                continue;
+            TelemetryReport::OptionStats stats;
+            stats.section = section.first;
+            stats.name = option.first;
+            stats.reads = counter->getReads();
+            stats.writes = counter->getWrites();
+            stats.wasRead = counter->wasRead();
+            sectionStats.reads += stats.reads;
+            sectionStats.writes += stats.writes;
+            if (!stats.wasRead)
+                ++sectionStats.unreadOptions;
+            report.options.push_back(std::move(stats));
+        }
+        report.sections.push_back(std::move(sectionStats));
+    }
+    return report;
+}
+
+std::string File::buildDelta(const File& target) const
+{
+    std::string delta;
+    Delta::build(*this, target, delta);
+    return delta;
+}
+
+bool File::applyDelta(std::string_view delta)
+{
+    return Delta::apply(*this, delta);
+}
+
+FrozenFile File::freeze() const
+{
+    return FrozenFile(*this);
+}
+
+MemoryUsage File::memoryUsage() const
+{
+    MemoryUsage usage;
+    for (const auto& section: options)
+        usage += getSectionUsage(section.first, section.second);
+    std::lock_guard<std::mutex> lock(textCache.mutex);
+    for (const auto& section: textCache.sections)
+        usage.caches += sizeof(section) + MemoryUsage::getHeapSize(section.first) + MemoryUsage::getHeapSize(section.second.text);
+    return usage;
+}
+
+MemoryUsage File::memoryUsage(std::string_view section) const
+{
+    auto sectionFound = options.find(section);
+    if (sectionFound == options.end())
+        return MemoryUsage();
+    return getSectionUsage(sectionFound->first, sectionFound->second);
+}
+
+void File::shrinkToFit()
+{
+    for (auto& section: options)
+    {
+        // Names can only be changed while their nodes are out of the map, which keeps the options where they are
+        for (auto it = section.second.begin(); it != section.second.end(); )
+        {
+            auto next = std::next(it);
+            it->second.shrinkToFit();
+            if (MemoryUsage::getHeapSize(it->first) > it->first.size() + 1)
+            {
+                auto node = section.second.extract(it);
+                node.key().shrink_to_fit();
+                section.second.insert(next, std::move(node));
+            }
+            it = next;
+        }
+    }
+}
+
+void File::setStringPool(std::shared_ptr<StringPool> pool)
+{
+    stringPool = std::move(pool);
+    if (stringPool)
+    {
+        for (auto& section: options)
+        {
+            for (auto& option: section.second)
+                option.second.intern(*stringPool);
+        }
+    }
+}
+
+const std::shared_ptr<StringPool>& File::getStringPool() const
+{
+    return stringPool;
+}
+
+bool File::isDirty() const
+{
+    if (options.size() != savedSizes.size())
+        return true;
+    for (const auto& section: options)
+    {
+        if (isDirty(section.first))
+            return true;
+    }
+    return false;
+}
+
+bool File::isDirty(const std::string& section) const
+{
+    auto sectionFound = options.find(section);
+    auto savedFound = savedSizes.find(section);
+    if (sectionFound == options.end())
+        return (savedFound != savedSizes.end()); // Dirty if it was erased
+    if (savedFound == savedSizes.end() || savedFound->second != sectionFound->second.size())
+        return true; // Dirty if it was added, or if options were added/erased
+    for (const auto& option: sectionFound->second)
+    {
+        if (option.second.getRevision() > savedRevision)
+            return true;
+    }
+    return false;
+}
+
+bool File::writeChanges() const
+{
+    if (!isDirty())
+        return true;
+    return writeToFile();
+}
+
+void File::startAutosave(std::chrono::milliseconds quietPeriod)
+{
+    autosave.start(*this, quietPeriod);
+}
+
+void File::stopAutosave()
+{
+    if (autosave.stop())
+        writeChanges();
+}
+
+std::unique_lock<std::mutex> File::lock()
+{
+    return std::unique_lock<std::mutex>(autosave.getMutex());
 }
 
 void File::parseLines(std::vector<std::string>& lines)
 {
-    currentArrayStack.clear();
+    arrayStack.clear();
     arrayOptionName.clear();
     std::string section;
     bool multiLineComment = false;
     Comment commentType = Comment::None;
-    for (std::string& line: lines) // Iterate through the std::vector of strings
+    for (currentLine = 0; currentLine < lines.size() && parseError.empty(); ++currentLine) // Iterate through the std::vector of strings
     {
+        std::string& line = lines[currentLine];
+        if (parseLimits.maxLineLength && line.size() > parseLimits.maxLineLength)
+        {
+            stopParsing("Line is longer than " + std::to_string(parseLimits.maxLineLength) + " characters");
+            break;
+        }
+        if (!lineOffsets.empty())
+        {
+            // Keep track of where the trimmed line starts in the source
+            size_t indent{0};
+            while (indent < line.size() && std::isspace(static_cast<unsigned char>(line[indent])))
+                ++indent;
+            lineOffsets[currentLine] += indent;
+        }
         strlib::trimWhitespace(line);
         commentType = stripComments(line, multiLineComment);
 
@@ -230,6 +639,66 @@ void File::parseLines(std::vector<std::string>& lines)
     }
 }
 
+bool File::finishLoading(bool status, const std::string& source)
+{
+    auto loadRevision = Option::nextRevision();
+    fileIoSuccessful = status;
+    if (fileIoSuccessful)
+        fileIoSuccessful = parseString(source);
+    else if (flags & Verbose)
+        std::cout << "Error loading \"" << configFilename << "\"\n";
+
+    // Only matches the file if every option came from it
+    if (fileIoSuccessful && allChangedSince(loadRevision))
+        markClean();
+    notifyChange();
+    return fileIoSuccessful;
+}
+
+AsyncIo::RequestPtr File::makeWriteRequest(const std::string& filename) const
+{
+    // The string is built now, so the options can be changed while it is being written
+    bool verbose = (flags & Verbose);
+    return AsyncIo::makeWrite(filename, buildString(), [verbose, filename](bool status, std::string&)
+    {
+        if (!status && verbose)
+            std::cout << "Error writing \"" << filename << "\"\n";
+        return status;
+    });
+}
+
+bool File::parseString(const std::string& str)
+{
+    parseError.clear();
+    parsedOptions = 0;
+    if (parseLimits.maxBytes && str.size() > parseLimits.maxBytes)
+    {
+        // Nothing is parsed, so a large source doesn't even get split into lines
+        stopParsing("The source is larger than " + std::to_string(parseLimits.maxBytes) + " bytes", false);
+        return false;
+    }
+    if (flags & PreserveLayout)
+        parseSource(str);
+    else
+    {
+        layout.clear();
+        auto lines = strlib::getLinesFromString(str);
+        parseLines(lines);
+    }
+    resolveInterpolation();
+    attachTelemetry();
+    return parseError.empty();
+}
+
+void File::parseSource(const std::string& source)
+{
+    auto lines = strlib::getLinesFromString(source, lineOffsets);
+    layout.reset(source, lineOffsets);
+    parseLines(lines);
+    layout.finish(*this);
+    lineOffsets.clear();
+}
+
 bool File::isSection(const std::string& section) const
 {
     return (section.size() >= 2 && section.front() == '[' && section.back() == ']');
@@ -238,39 +707,23 @@ bool File::isSection(const std::string& section) const
 void File::parseSectionLine(const std::string& line, std::string& section)
 {
     section = line.substr(1, line.size() - 2); // Set the current section
-    options[section]; // Add that section to the map
+    findOrAddSection(section); // Add that section to the map
+    if (!lineOffsets.empty())
+        layout.recordSection(section, currentLine);
 }
 
 void File::parseOptionLine(const std::string& line, const std::string& section)
 {
-    if (!currentArrayStack.empty())
-    {
-        // Process another line in the array
-        // This could be 1 of 3 things:
-        // 1. { (array start)
-        // 2. X (another value)
-        // 3. } (array end)
-        std::string value = line;
-        strlib::trimWhitespace(value);
-        if (value.back() == ',')
-            value.pop_back();
-        strlib::trimWhitespace(value); // In case there was whitespace before the comma
-        if (!value.empty())
-        {
-            Option& option = getArrayOption(section, arrayOptionName);
-            if (value == "{")
-                startArray(option);
-            else if (value == "}")
-                currentArrayStack.pop_back();
-            else
-                setOption(option.push(), value);
-        }
+    if (!arrayStack.empty())
+    {
+        // Process another line in the array, which can have any number of elements, "{", and "}"
+        parseArrayLine(line, 0, section);
     }
     else
     {
         // Process a regular option line (or the start of a new array)
         size_t equalPos = line.find("="); // Find the position of the "=" symbol
-        if (equalPos != std::string::npos && equalPos >= 1) // Ignore the line if there is no "=" symbol
+        if (equalPos != std::string::npos && equalPos >= 1 && countParsedOption()) // Ignore the line if there is no "=" symbol
         {
             std::string name, value;
             // Extract the name and value
@@ -279,48 +732,185 @@ void File::parseOptionLine(const std::string& line, const std::string& section)
             // Trim any whitespace around the name and value
             strlib::trimWhitespace(name);
             strlib::trimWhitespace(value);
+            // Find where the value starts in the source
+            size_t valuePos = line.size() - value.size();
+            size_t valueBegin = std::string::npos;
+            if (!lineOffsets.empty())
+                valueBegin = lineOffsets[currentLine] + valuePos;
             // Check if this is the start of an array
-            Option& option = options[section][name];
-            if (value == "{")
+            Option& option = findOrAddSection(section)[name];
+            bool watched = isWatched(name, section);
+            if (!value.empty() && value.front() == '{')
             {
+                // The array replaces any previous elements, and can continue on the same line
+                arrayWatched = watched;
+                if (watched)
+                    arrayOldValue = option;
+                option.clear();
                 arrayOptionName = name;
-                currentArrayStack.assign(1, 0);
+                arrayStack.assign(1, &option);
+                arrayFirstLine = currentLine;
+                arrayValueBegin = valueBegin;
+                parseArrayLine(line, valuePos + 1, section);
             }
             else
             {
+                std::unique_ptr<Option> oldValue;
+                if (watched)
+                    oldValue = std::make_unique<Option>(option);
                 if (!setOption(option, value) && (flags & Verbose))
                 {
                     std::cout << "Warning: Option \"" << name << "\" in [" << section << "] was out of range.\n";
                     std::cout << "    Using default value: " << option.toStringWithQuotes() << std::endl;
                 }
+                if (!lineOffsets.empty())
+                    layout.recordOption(section, name, currentLine, currentLine, valueBegin, valueBegin + value.size());
+                if (oldValue)
+                    callWatchers(name, section, *oldValue, option);
+                if (flags & Interpolate)
+                    updateInterpolation(name, section, option);
+            }
+        }
+    }
+}
+
+void File::parseArrayLine(const std::string& line, size_t pos, const std::string& section)
+{
+    // Long runs of elements are added to an empty array without reallocating
+    Option& first = *arrayStack.back();
+    if (first.size() == 0)
+    {
+        size_t commas = std::count(line.begin() + pos, line.end(), ',');
+        if (commas >= 16)
+            first.reserve(commas + 1);
+    }
+
+    size_t size = line.size();
+    while (pos < size && !arrayStack.empty())
+    {
+        char c = line[pos];
+        if (c == ',' || std::isspace(static_cast<unsigned char>(c)))
+            ++pos;
+        else if (c == '{')
+        {
+            if (parseLimits.maxDepth && arrayStack.size() >= parseLimits.maxDepth)
+            {
+                stopParsing("Arrays are nested deeper than " + std::to_string(parseLimits.maxDepth));
+                return;
+            }
+            if (!countParsedOption())
+                return;
+
+            // The new element will be holding the array starting with this "{"
+            arrayStack.push_back(&arrayStack.back()->push());
+            ++pos;
+        }
+        else if (c == '}')
+        {
+            Option& closed = *arrayStack.back();
+            arrayStack.pop_back();
+            ++pos;
+            if (arrayStack.empty() && !lineOffsets.empty())
+            {
+                size_t valueEnd = lineOffsets[currentLine] + pos;
+                layout.recordOption(section, arrayOptionName, arrayFirstLine, currentLine, arrayValueBegin, valueEnd);
+            }
+            if (arrayStack.empty() && arrayWatched)
+            {
+                callWatchers(arrayOptionName, section, arrayOldValue, closed);
+                arrayWatched = false;
+            }
+            if (arrayStack.empty() && (flags & Interpolate))
+                updateInterpolation(arrayOptionName, section, closed);
+        }
+        else if (countParsedOption())
+            pos = parseArrayElement(*arrayStack.back(), line, pos);
+    }
+}
+
+size_t File::parseArrayElement(Option& array, const std::string& line, size_t pos)
+{
+    size_t end;
+    if (areQuotes(line[pos], line[pos]))
+    {
+        // Strings end at the last matching quote before the next element (so they can contain quotes, commas, and braces)
+        // With escape codes, escaped quotes never end a string
+        char quote = line[pos];
+        end = std::string::npos;
+        for (size_t i = line.find(quote, pos + 1); i != std::string::npos && end == std::string::npos; i = line.find(quote, i + 1))
+        {
+            if (flags & Escapes)
+            {
+                size_t backslashes = 0;
+                while (line[i - backslashes - 1] == '\\')
+                    ++backslashes;
+                if (backslashes % 2 != 0)
+                    continue;
             }
+            size_t next = line.find_first_not_of(" \t", i + 1);
+            if (next == std::string::npos || line[next] == ',' || line[next] == '}')
+                end = i + 1;
         }
+        if (end == std::string::npos)
+            end = line.size();
+        setOption(array.push(), line.substr(pos, end - pos));
+        return end;
     }
+
+    // Anything else goes until the next element
+    end = line.find_first_of(",}", pos);
+    if (end == std::string::npos)
+        end = line.size();
+    size_t tokenEnd = end;
+    while (tokenEnd > pos && std::isspace(static_cast<unsigned char>(line[tokenEnd - 1])))
+        --tokenEnd;
+    addArrayElement(array, std::string_view(line).substr(pos, tokenEnd - pos));
+    return end;
 }
 
 bool File::setOption(Option& option, const std::string& value)
+{
+    return setOption(option, value, (flags & Escapes) != 0);
+}
+
+bool File::setOption(Option& option, const std::string& value, bool escapes)
 {
     std::string trimmedValue = value;
     bool trimmedQuotes = trimQuotes(trimmedValue); // Remove quotes if any
+    if (trimmedQuotes && escapes)
+        strlib::unescape(trimmedValue); // Only quoted strings can have escape codes
     bool optionSet = (option = trimmedValue); // Try to set the option
     if (trimmedQuotes) // If quotes were removed
         option.setQuotes(true); // Add quotes to the option
+    if (stringPool)
+        option.intern(*stringPool);
     return optionSet;
 }
 
-Option& File::getArrayOption(const std::string& section, const std::string& name)
-{
-    Option* currentOption = &options[section][name];
-    // Start at 1, because the 0th element represents the current option above
-    for (unsigned i = 1; i < currentArrayStack.size(); ++i)
-        currentOption = &((*currentOption)[currentArrayStack[i]]);
-    return *currentOption;
-}
-
-void File::startArray(Option& option)
+void File::addArrayElement(Option& array, std::string_view value)
 {
-    option.push(); // This new option will be holding the array starting with this "{"
-    currentArrayStack.push_back(option.size() - 1);
+    // Plain numbers are added directly, so numeric arrays stay contiguous
+    double decimalVal;
+    if (strlib::fromChars(value, decimalVal))
+    {
+        // Whole numbers that are too large for a double to hold exactly are parsed again as integers
+        long integerVal;
+        if (std::abs(decimalVal) >= 9007199254740992.0 && strlib::fromChars(value, integerVal))
+        {
+            if (Option::isCanonicalNumber(value, static_cast<double>(integerVal), integerVal))
+            {
+                array.pushNumber(integerVal);
+                return;
+            }
+        }
+        else if (Option::isCanonicalNumber(value, decimalVal, static_cast<long>(decimalVal)))
+        {
+            array.pushNumber(decimalVal);
+            return;
+        }
+    }
+    // Anything else (including numbers written differently, like "1.50") is kept as text
+    setOption(array.push(), std::string(value));
 }
 
 bool File::areQuotes(char c1, char c2)
@@ -342,6 +932,24 @@ bool File::trimQuotes(std::string& str)
     return status;
 }
 
+bool File::countParsedOption()
+{
+    if (parseLimits.maxOptions && ++parsedOptions > parseLimits.maxOptions)
+    {
+        stopParsing("More than " + std::to_string(parseLimits.maxOptions) + " options and array elements");
+        return false;
+    }
+    return true;
+}
+
+void File::stopParsing(const std::string& reason, bool atLine)
+{
+    parseError = (atLine ? "Line " + std::to_string(currentLine + 1) + ": " + reason : reason);
+    arrayStack.clear(); // Unfinished arrays are kept as they are
+    if (flags & Verbose)
+        std::cout << "Error parsing config: " << parseError << std::endl;
+}
+
 bool File::isEndComment(const std::string& str) const
 {
     return (str.find("*/") != std::string::npos);
@@ -381,4 +989,386 @@ File::Comment File::stripComments(std::string& str, bool checkEnd)
     return commentType;
 }
 
+File::Cursor File::getCursor(std::string_view path)
+{
+    return Cursor(*this, sectionTree.getNode(path));
+}
+
+const File::Section* File::findSection(std::string_view section) const
+{
+    const SectionNode* node = sectionTree.findNode(section);
+    if (node && node->section)
+        return node->section;
+
+    // The section could have been added without being looked up yet
+    if (sectionTree.getLinkCount() < options.size())
+    {
+        auto sectionFound = options.find(section);
+        if (sectionFound != options.end())
+            return &sectionFound->second;
+    }
+    return nullptr;
+}
+
+File::Section* File::findSection(std::string_view section)
+{
+    SectionNode* node = sectionTree.findNode(section);
+    if (node && node->section)
+        return node->section;
+
+    // Remember sections that were added without being looked up yet
+    if (sectionTree.getLinkCount() < options.size())
+    {
+        auto sectionFound = options.find(section);
+        if (sectionFound != options.end())
+        {
+            sectionTree.link(sectionTree.getNode(section), &sectionFound->second);
+            return &sectionFound->second;
+        }
+    }
+    return nullptr;
+}
+
+File::Section& File::findOrAddSection(std::string_view section)
+{
+    Section* sectionFound = findSection(section);
+    if (sectionFound)
+        return *sectionFound;
+    Section& newSection = options.emplace(section, Section()).first->second;
+    sectionTree.link(sectionTree.getNode(section), &newSection);
+    return newSection;
+}
+
+File::Cursor::Cursor(File& file, SectionNode& node):
+    file(&file),
+    node(&node)
+{
+}
+
+File::Cursor File::Cursor::child(std::string_view name) const
+{
+    // Only the part below this section needs to be walked
+    return Cursor(*file, file->sectionTree.getNode(*node, name));
+}
+
+Option& File::Cursor::operator()(const std::string& name) const
+{
+    return getSection()[name];
+}
+
+bool File::Cursor::optionExists(const std::string& name) const
+{
+    return (sectionExists() && node->section->find(name) != node->section->end());
+}
+
+File::Section& File::Cursor::getSection() const
+{
+    file->notifyChange();
+    if (!node->section)
+        file->findOrAddSection(node->path);
+    return *node->section;
+}
+
+bool File::Cursor::sectionExists() const
+{
+    return (node->section || file->findSection(node->path));
+}
+
+const std::string& File::Cursor::getPath() const
+{
+    return node->path;
+}
+
+std::vector<std::string> File::Cursor::getChildNames() const
+{
+    // Link any sections that were added without being looked up, so they are in the tree
+    if (file->sectionTree.getLinkCount() < file->options.size())
+    {
+        for (const auto& section: file->options)
+            file->findSection(section.first);
+    }
+    std::vector<std::string> names;
+    for (const auto& child: node->children)
+        names.push_back(child.second->name);
+    std::sort(names.begin(), names.end());
+    return names;
+}
+
+File::SectionTree::SectionTree(const SectionTree&)
+{
+}
+
+File::SectionTree& File::SectionTree::operator=(const SectionTree&)
+{
+    // The nodes are kept for any existing cursors
+    unlinkAll();
+    return *this;
+}
+
+File::SectionNode& File::SectionTree::getNode(std::string_view path)
+{
+    return getNode(root, path);
+}
+
+File::SectionNode& File::SectionTree::getNode(SectionNode& start, std::string_view path)
+{
+    if (path.empty())
+        return start;
+    SectionNode* node = &start;
+    for (size_t begin = 0; begin <= path.size(); )
+    {
+        size_t end = std::min(path.find('.', begin), path.size());
+        std::string_view part = path.substr(begin, end - begin);
+        auto childFound = node->children.find(part);
+        if (childFound == node->children.end())
+        {
+            auto newNode = std::make_unique<SectionNode>();
+            newNode->name = std::string(part);
+            newNode->path = (node == &root ? newNode->name : node->path + '.' + newNode->name);
+            newNode->parent = node;
+            // The key points to the name inside of the node, so it lives as long as the node
+            std::string_view key = newNode->name;
+            childFound = node->children.emplace(key, std::move(newNode)).first;
+        }
+        node = childFound->second.get();
+        begin = end + 1;
+    }
+    return *node;
+}
+
+File::SectionNode* File::SectionTree::findNode(std::string_view path) const
+{
+    if (path.empty())
+        return const_cast<SectionNode*>(&root);
+    const SectionNode* node = &root;
+    for (size_t begin = 0; begin <= path.size(); )
+    {
+        size_t end = std::min(path.find('.', begin), path.size());
+        auto childFound = node->children.find(path.substr(begin, end - begin));
+        if (childFound == node->children.end())
+            return nullptr;
+        node = childFound->second.get();
+        begin = end + 1;
+    }
+    return const_cast<SectionNode*>(node);
+}
+
+void File::SectionTree::link(SectionNode& node, Section* section)
+{
+    if (!node.section && section)
+        ++linkCount;
+    else if (node.section && !section)
+        --linkCount;
+    node.section = section;
+}
+
+void File::SectionTree::unlink(std::string_view path)
+{
+    SectionNode* node = findNode(path);
+    if (node)
+        link(*node, nullptr);
+}
+
+void File::SectionTree::unlinkAll()
+{
+    unlinkAll(root);
+    linkCount = 0;
+}
+
+size_t File::SectionTree::getLinkCount() const
+{
+    return linkCount;
+}
+
+void File::SectionTree::unlinkAll(SectionNode& node)
+{
+    node.section = nullptr;
+    for (auto& child: node.children)
+        unlinkAll(*child.second);
+}
+
+unsigned File::onChange(const std::string& name, const std::string& section, ChangeCallback callback)
+{
+    unsigned id = ++lastCallbackId;
+    watchers[section].optionCallbacks[name].emplace_back(id, std::move(callback));
+    callbackNames.emplace(id, std::make_pair(name, section));
+    return id;
+}
+
+unsigned File::onSectionChange(const std::string& section, ChangeCallback callback)
+{
+    unsigned id = ++lastCallbackId;
+    watchers[section].sectionCallbacks.emplace_back(id, std::move(callback));
+    callbackNames.emplace(id, std::make_pair(std::string(), section));
+    return id;
+}
+
+bool File::removeCallback(unsigned id)
+{
+    auto nameFound = callbackNames.find(id);
+    if (nameFound == callbackNames.end())
+        return false;
+    const std::string& name = nameFound->second.first;
+    const std::string& section = nameFound->second.second;
+    auto watchersFound = watchers.find(section);
+    Watchers& sectionWatchers = watchersFound->second;
+    CallbackList& callbacks = (name.empty() ? sectionWatchers.sectionCallbacks : sectionWatchers.optionCallbacks[name]);
+    callbacks.erase(std::find_if(callbacks.begin(), callbacks.end(), [id](const auto& callback){ return callback.first == id; }));
+
+    // Clean up anything that is empty now, so isWatched stays fast
+    if (!name.empty() && callbacks.empty())
+        sectionWatchers.optionCallbacks.erase(name);
+    if (sectionWatchers.sectionCallbacks.empty() && sectionWatchers.optionCallbacks.empty())
+        watchers.erase(watchersFound);
+    callbackNames.erase(nameFound);
+    return true;
+}
+
+bool File::isWatched(const std::string& name, const std::string& section) const
+{
+    if (watchers.empty())
+        return false;
+    auto watchersFound = watchers.find(section);
+    if (watchersFound == watchers.end())
+        return false;
+    const Watchers& sectionWatchers = watchersFound->second;
+    return (!sectionWatchers.sectionCallbacks.empty() || sectionWatchers.optionCallbacks.count(name) > 0);
+}
+
+void File::callWatchers(const std::string& name, const std::string& section, const Option& oldValue, const Option& newValue)
+{
+    if (oldValue.buildArrayString() == newValue.buildArrayString())
+        return; // Nothing changed
+    auto watchersFound = watchers.find(section);
+    if (watchersFound == watchers.end())
+        return;
+    const Watchers& sectionWatchers = watchersFound->second;
+    auto optionFound = sectionWatchers.optionCallbacks.find(name);
+    if (optionFound != sectionWatchers.optionCallbacks.end())
+    {
+        for (const auto& callback: optionFound->second)
+            callback.second(name, section, oldValue, newValue);
+    }
+    for (const auto& callback: sectionWatchers.sectionCallbacks)
+        callback.second(name, section, oldValue, newValue);
+}
+
+void File::assignOption(const std::string& name, const std::string& section, const Option& value)
+{
+    Option& option = findOrAddSection(section)[name];
+    telemetry.attach(option);
+    if (!isWatched(name, section) && !(flags & Interpolate))
+    {
+        option = value;
+        return;
+    }
+    Option oldValue(option);
+    option = value;
+    callWatchers(name, section, oldValue, option);
+    if (flags & Interpolate)
+        updateInterpolation(name, section, option);
+}
+
+void File::writeSection(const std::string& name, const Section& section, std::string& str) const
+{
+    str.clear();
+    if (!name.empty())
+        str += '[' + name + "]\n"; // Add the section line if it is not blank
+    for (const auto& o: section) // Go through all of the options in this section
+        str += o.first + " = " + buildValueString(o.first, name, o.second) + '\n';
+    str += '\n';
+}
+
+std::string File::buildValueString(const std::string& name, const std::string& section, const Option& option) const
+{
+    // Templates are written instead of their resolved values, so they still work when loaded again
+    if (!interpolation.empty())
+    {
+        const std::string* text = interpolation.findTemplate(name, section, option);
+        if (text)
+            return *text;
+    }
+    return option.buildArrayString("", (flags & Escapes) != 0);
+}
+
+void File::updateInterpolation(const std::string& name, const std::string& section, Option& option)
+{
+    AccessCounter::Pause pause; // Finding references is not a read by the program
+    if (option.size() > 0)
+        interpolation.update(name, section, "", false, false); // Arrays can be used, but are not templates
+    else
+        interpolation.update(name, section, option.toString(), option.hasQuotes(), (flags & Escapes) != 0);
+}
+
+void File::attachTelemetry()
+{
+    if (telemetry.isEnabled())
+    {
+        for (auto& section: options)
+        {
+            for (auto& option: section.second)
+                telemetry.attach(option.second);
+        }
+    }
+}
+
+void File::resolveInterpolation()
+{
+    if ((flags & Interpolate) && !interpolation.resolve(*this) && (flags & Verbose))
+        std::cout << "Warning: Some values reference themselves, so they were not interpolated.\n";
+}
+
+File::TextCache::TextCache(const TextCache&)
+{
+}
+
+File::TextCache& File::TextCache::operator=(const TextCache&)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    sections.clear();
+    return *this;
+}
+
+MemoryUsage File::getSectionUsage(const std::string& name, const Section& section)
+{
+    // Each node of a std::map has a color and three pointers, besides the key and value
+    const size_t nodeOverhead = sizeof(int) + 3 * sizeof(void*);
+    MemoryUsage usage;
+    usage.nodes = nodeOverhead + sizeof(std::string) + sizeof(Section);
+    usage.keys = MemoryUsage::getHeapSize(name);
+    for (const auto& option: section)
+    {
+        usage.nodes += nodeOverhead + sizeof(std::string);
+        usage.keys += MemoryUsage::getHeapSize(option.first);
+        usage += option.second.memoryUsage();
+    }
+    return usage;
+}
+
+void File::markClean() const
+{
+    savedRevision = Option::nextRevision();
+    savedSizes.clear();
+    for (const auto& section: options)
+        savedSizes.emplace_hint(savedSizes.end(), section.first, section.second.size());
+}
+
+bool File::allChangedSince(std::uint64_t revision) const
+{
+    for (const auto& section: options)
+    {
+        for (const auto& option: section.second)
+        {
+            if (option.second.getRevision() <= revision)
+                return false;
+        }
+    }
+    return true;
+}
+
+void File::notifyChange()
+{
+    autosave.notify();
+}
+
 }
@@ -5,9 +5,23 @@
 #define CFG_FILE_H
 
 #include <map>
+#include <memory>
+#include <unordered_map>
 #include <vector>
 #include <string>
+#include <string_view>
+#include <chrono>
+#include <mutex>
+#include <functional>
+#include <future>
+#include <utility>
 #include "configoption.h"
+#include "configlayout.h"
+#include "configinterpolation.h"
+#include "configfrozen.h"
+#include "configdelta.h"
+#include "configautosave.h"
+#include "configasync.h"
 
 namespace cfg
 {
@@ -15,28 +29,38 @@ namespace cfg
 /*
 A class for reading/writing configuration files.
 See README.md for more information.
-
-TODO:
-    Handle escape codes inside of strings.
-    Handle multiple array elements on the same line.
-    Support sub-sections by using a tree, similar to Option arrays.
-    Writing should optionally preserve formatting and comments.
 */
 class File
 {
     public:
         enum Flags
         {
-            NoFlags = 0b00,
-            Verbose = 0b01,  // Display file IO errors and when options are out of range
-            Autosave = 0b10, // Automatically save the last file loaded on destruction
-            AllFlags = 0b11
+            NoFlags = 0b000,
+            Verbose = 0b001,  // Display file IO errors and when options are out of range
+            Autosave = 0b010, // Automatically save the last file loaded on destruction
+            PreserveLayout = 0b100, // Writing only patches the changed options, keeping comments and formatting
+            Interpolate = 0b1000, // Values can use other options with "${Section.option}"
+            ParallelWrite = 0b10000, // Large changes are serialized on multiple threads
+            Escapes = 0b100000, // Quoted strings can use escape codes like "\n" (and are saved with them)
+            AllFlags = 0b111111
         };
         static const int DefaultFlags = Verbose;
 
+        // Limits for parsing sources that can't be trusted (zero means no limit)
+        struct ParseLimits
+        {
+            static const size_t DefaultMaxDepth = 256;
+
+            size_t maxBytes{}; // Size of the whole source (files are only read up to this size)
+            size_t maxLineLength{}; // Size of each line
+            size_t maxDepth{DefaultMaxDepth}; // Arrays inside of arrays (a normal array has a depth of 1)
+            size_t maxOptions{}; // Options and array elements that are read
+        };
+
         // Types used to store the options
-        using Section = std::map<std::string, Option>;
-        using ConfigMap = std::map<std::string, Section>;
+        // These use std::less<> so they can be searched with std::string_view without making a std::string
+        using Section = std::map<std::string, Option, std::less<>>;
+        using ConfigMap = std::map<std::string, Section, std::less<>>;
 
         // Constructors
         File();
@@ -47,22 +71,42 @@ class File
 
         // Loading/saving
         bool loadFromFile(const std::string& filename); // Loads options from a file
-        void loadFromString(const std::string& str); // Loads options from a string
+        bool loadFromString(const std::string& str); // Loads options from a string, returns false if a parse limit was reached
+        void loadFromEmbedded(const EmbeddedConfig& config); // Loads options generated at build time by cfg_embed, without parsing anything
         bool writeToFile(std::string filename = "") const; // Saves current options to a file (default is last loaded)
         void writeToString(std::string& str) const; // Saves current options to a string (same format as writeToFile)
         std::string buildString() const; // Returns a string of the current options (same format as writeToFile)
         explicit operator bool() const; // Returns true if the last file loaded/saved successfully
+
+        // Asynchronous loading/saving (the IO is done with io_uring on Linux when available, or a thread pool)
+        // The file must not be used until a load is ready. Saves build the output before returning,
+        // except with PreserveLayout, where the options must not be changed until the save is ready.
+        // Saving asynchronously does not change the dirty state (see isDirty).
+        std::future<bool> loadFromFileAsync(const std::string& filename); // Same as loadFromFile, but does not block
+        std::future<bool> writeToFileAsync(std::string filename = "") const; // Same as writeToFile, but does not block
+        static std::vector<std::future<bool>> loadFromFilesAsync(const std::vector<std::pair<File*, std::string>>& files); // Loads many files at once
+        static std::vector<std::future<bool>> writeToFilesAsync(const std::vector<const File*>& files); // Saves many files at once (to their last loaded files)
         bool getStatus() const; // Returns true if the last file loaded/saved successfully
 
         // Settings
         void setFlag(int flag, bool state = true); // Turns a flag on/off
         void setFlags(int newFlags = DefaultFlags); // Overwrites all flags
+        void setParseLimits(const ParseLimits& limits); // Loading stops at the first limit that is reached (the options before it are kept)
+        const ParseLimits& getParseLimits() const;
+        const std::string& getParseError() const; // Returns why the last load stopped early, or an empty string
 
         // Accessing/modifying options
         Option& operator()(const std::string& name, const std::string& section); // Returns a reference to an option with the specified name (and section). If it does not exist, it will be automatically created
         Option& operator()(const std::string& name); // Same as above but uses the current section
         bool optionExists(const std::string& name, const std::string& section) const; // Returns true if an option exists
         bool optionExists(const std::string& name) const; // Returns true if an option exists
+        const Option* find(std::string_view name, std::string_view section) const; // Returns an option, or null if it does not exist (never adds anything)
+        const Option* find(std::string_view name) const; // Same as above but uses the current section
+        template <typename Type>
+        Type get(std::string_view name, std::string_view section, const Type& defaultValue) const; // Returns the value of an option, or the default value if it does not exist
+        std::string get(std::string_view name, std::string_view section, const char* defaultValue) const; // Same as above, for string literals
+        template <typename Type>
+        bool set(const std::string& name, const std::string& section, const Type& value); // Same as operator() = value, but also calls the change callbacks
         void setDefaultOptions(const ConfigMap& defaultOptions); // Sets initial values in the map from another map in memory
         ConfigMap::iterator begin(); // Returns an iterator to the beginning of the map
         ConfigMap::iterator end(); // Returns an iterator to the end of the map
@@ -74,6 +118,14 @@ class File
         bool sectionExists(const std::string& section) const; // Returns true if a section exists
         bool sectionExists() const; // Returns true if a section exists
 
+        // Prefix queries, which only visit the matching names (in sorted order)
+        template <typename Function>
+        void forEachWithPrefix(std::string_view prefix, std::string_view section, Function function) const; // Calls function(name, option) for each option starting with the prefix
+        size_t countWithPrefix(std::string_view prefix, std::string_view section) const; // Returns the number of options starting with the prefix
+        template <typename Function>
+        void forEachSectionWithPrefix(std::string_view prefix, Function function) const; // Calls function(name, section) for each section starting with the prefix
+        size_t countSectionsWithPrefix(std::string_view prefix) const; // Returns the number of sections starting with the prefix
+
         // Erasing options/sections
         bool eraseOption(const std::string& name, const std::string& section); // Erases an option, returns true if the option was successfully erased
         bool eraseOption(const std::string& name); // Erases an option from the default section
@@ -81,7 +133,126 @@ class File
         bool eraseSection(); // Erases the default section
         void clear(); // Clears all of the sections and options in memory, but keeps the filename
 
+        // Telemetry, for finding options that are never read (or read very often)
+        // Each option gets a counter, so this uses some memory for each option while it is enabled (counters of erased options are reused)
+        void enableTelemetry(unsigned sampleInterval = 1); // Reads are only added every "sampleInterval" times for each option, making them estimates
+        void disableTelemetry(); // Stops counting, and frees the counters
+        TelemetryReport getTelemetryReport() const; // Returns the counts of every option that is being counted
+
+        // Deltas, for sending only the changes to other copies of a file (see configdelta.h for the format)
+        std::string buildDelta(const File& target) const; // Returns the changes that turn this file into the target
+        bool applyDelta(std::string_view delta); // Applies changes from buildDelta, returns false if a change could not be applied
+
+        // Returns a read-only copy of all of the options, which uses a perfect hash for faster lookups
+        FrozenFile freeze() const;
+
+        // Memory usage
+        MemoryUsage memoryUsage() const; // Returns the bytes used by all of the sections and options
+        MemoryUsage memoryUsage(std::string_view section) const; // Returns the bytes used by a section (zero if it does not exist)
+        void shrinkToFit(); // Frees unused capacity left over from parsing and adding array elements
+
+        // Shared text
+        // Long quoted strings that are loaded share their text with the pool, which can be shared by many files (names are not shared)
+        void setStringPool(std::shared_ptr<StringPool> pool); // Also shares the strings already loaded (null stops sharing)
+        const std::shared_ptr<StringPool>& getStringPool() const;
+
+        // Change tracking
+        bool isDirty() const; // Returns true if anything changed since the last load/save
+        bool isDirty(const std::string& section) const; // Returns true if a section changed since the last load/save
+        bool writeChanges() const; // Saves to the last loaded file, but only if something changed
+        void startAutosave(std::chrono::milliseconds quietPeriod); // Saves changes in the background, once nothing has changed for the quiet period
+        void stopAutosave(); // Stops saving in the background, and saves any remaining changes
+        std::unique_lock<std::mutex> lock(); // Hold this while reading or changing options from other threads when autosave is running
+
+        // Change callbacks, which are called when loading or set() changes the value of an option
+        // They are kept when the file is cleared or loaded again, and must not add/remove callbacks themselves
+        using ChangeCallback = std::function<void(const std::string& name, const std::string& section, const Option& oldValue, const Option& newValue)>;
+        unsigned onChange(const std::string& name, const std::string& section, ChangeCallback callback); // Watches an option, returns an ID for removing the callback
+        unsigned onSectionChange(const std::string& section, ChangeCallback callback); // Watches every option in a section
+        bool removeCallback(unsigned id); // Removes a callback, returns true if it existed
+
     private:
+        struct SectionNode;
+
+    public:
+        // A handle to a section in the tree of sub-sections, which resolves names relative to it
+        // Sub-sections are separated with dots, so "limits" under "server.http" is "server.http.limits"
+        // Cursors stay valid for the lifetime of the file, even if their section is erased and added again
+        class Cursor
+        {
+            public:
+                Cursor child(std::string_view name) const; // Returns a cursor to a sub-section (which may not exist yet)
+                Option& operator()(const std::string& name) const; // Returns a reference to an option in this section, creating it if needed
+                bool optionExists(const std::string& name) const; // Returns true if an option exists in this section
+                Section& getSection() const; // Returns a reference to this section, creating it if needed
+                bool sectionExists() const; // Returns true if this section exists
+                const std::string& getPath() const; // Returns the full name of this section
+                std::vector<std::string> getChildNames() const; // Returns the names of the existing sub-sections (not the full names)
+
+            private:
+                friend class File;
+                Cursor(File& file, SectionNode& node);
+
+                File* file;
+                SectionNode* node;
+        };
+
+        Cursor getCursor(std::string_view path = ""); // Returns a cursor to a section by its full name
+
+        class Transaction; // Stages many changes and applies them at once, see configtransaction.h
+
+    private:
+        friend class Layout;
+        friend class Interpolation;
+        friend class ConcurrentFile;
+        friend class FrozenFile;
+        friend class Delta;
+        friend class SharedPublisher;
+
+        // A section in the tree, which is kept next to the map so sections can be found by walking their path
+        struct SectionNode
+        {
+            std::string name; // The last part of the path, which the parent uses as a key
+            std::string path; // The full name of the section
+            SectionNode* parent{};
+            Section* section{}; // The section in the map, or null if it does not exist
+            std::unordered_map<std::string_view, std::unique_ptr<SectionNode>> children;
+        };
+
+        // Sections are only added to the tree when they are first looked up, so it never needs to be rebuilt
+        // Nodes are never removed, so cursors can keep pointing to them
+        class SectionTree
+        {
+            public:
+                SectionTree() = default;
+                SectionTree(const SectionTree&); // Copies start empty, since the sections belong to another map
+                SectionTree& operator=(const SectionTree&);
+                SectionNode& getNode(std::string_view path); // Returns the node of a path, adding any missing nodes
+                SectionNode& getNode(SectionNode& start, std::string_view path); // Same as above, but the path is relative to another node
+                SectionNode* findNode(std::string_view path) const; // Returns the node of a path, or null if it was never added
+                void link(SectionNode& node, Section* section); // Points a node to its section in the map
+                void unlink(std::string_view path); // Forgets about an erased section
+                void unlinkAll(); // Forgets about all of the sections
+                size_t getLinkCount() const; // Returns the number of nodes pointing to a section
+
+            private:
+                void unlinkAll(SectionNode& node);
+
+                SectionNode root;
+                size_t linkCount{};
+        };
+
+        // Returns the range of keys in a map that start with a prefix
+        template <typename Map>
+        static std::pair<typename Map::const_iterator, typename Map::const_iterator> findPrefix(const Map& map, std::string_view prefix);
+
+        static MemoryUsage getSectionUsage(const std::string& name, const Section& section); // Counts a section, including its node in the map
+
+        // Section lookup
+        const Section* findSection(std::string_view section) const; // Returns a section, or null if it does not exist (never changes anything, so it is safe for concurrent readers)
+        Section* findSection(std::string_view section); // Same as above, but also adds the section to the tree
+        Section& findOrAddSection(std::string_view section); // Returns a section, adding it if needed
+
         enum class Comment
         {
             None,   // No comment
@@ -91,33 +262,172 @@ class File
         };
 
         // File parsing
+        bool finishLoading(bool status, const std::string& source); // Parses a loaded file, and updates the status
+        AsyncIo::RequestPtr makeWriteRequest(const std::string& filename) const; // Builds the output for an asynchronous save
+        bool parseString(const std::string& str); // Parses a string, recording the layout if needed, returns false if a limit was reached
         void parseLines(std::vector<std::string>& lines); // Processes the lines in memory and adds them to the options map
+        void parseSource(const std::string& source); // Splits the source into lines and parses them, while recording the layout
         bool isSection(const std::string& section) const; // Returns true if the line is a section header
         void parseSectionLine(const std::string& line, std::string& section); // Processes a section header line and adds a section to the map
         void parseOptionLine(const std::string& line, const std::string& section); // Processes an option line and adds an option to the map
+        void parseArrayLine(const std::string& line, size_t pos, const std::string& section); // Processes array elements, starting at "pos"
+        size_t parseArrayElement(Option& array, const std::string& line, size_t pos); // Adds the element at "pos", returns where it ends
         bool setOption(Option& option, const std::string& value); // Sets an existing option
-        Option& getArrayOption(const std::string& section, const std::string& name); // Returns an option at the current array level
-        void startArray(Option& option); // Starts another array when "{" is found
+        bool setOption(Option& option, const std::string& value, bool escapes); // Same as above, but decodes escape codes if "escapes" is true
+        void addArrayElement(Option& array, std::string_view value); // Adds an unquoted element to an array
         bool areQuotes(char c1, char c2); // Returns true if both characters are either single or double quotes
         bool trimQuotes(std::string& str); // Trims quotes on ends of string, returns true if the string was modified
+        bool countParsedOption(); // Counts an option or array element, returns false if there are too many
+        void stopParsing(const std::string& reason, bool atLine = true); // Stops parsing because a limit was reached
 
         // Comment handling
         bool isEndComment(const std::string& str) const; // Returns true if it contains a multiple-line end comment symbol
         Comment getCommentType(const std::string& str, bool checkEnd = false) const; // Returns an enum value of the comment type
         Comment stripComments(std::string& str, bool checkEnd = false); // Removes all comments from a string
 
+        // Change tracking
+        void markClean() const; // Remembers the current options as being saved
+        bool allChangedSince(std::uint64_t revision) const; // Returns true if every option changed after a revision
+        void notifyChange(); // Wakes up the autosave worker
+
+        // Serialized text of each section, which writeToString reuses until the section changes
+        // The options of a cached section store their new revisions in "latest" (see Option::setParentRevision),
+        // so a section is unchanged if that is still the same, and it has the same number of options
+        struct SectionText
+        {
+            std::uint64_t revision{}; // Revision of the text
+            std::uint64_t latest{}; // Updated by the options when they change or are erased
+            size_t size{};
+            std::string text;
+        };
+        struct TextCache
+        {
+            TextCache() = default;
+            TextCache(const TextCache&); // Copies start empty, so the mutex does not need to be copied
+            TextCache& operator=(const TextCache&);
+            std::mutex mutex;
+            std::map<std::string, SectionText, std::less<>> sections;
+        };
+        void writeSection(const std::string& name, const Section& section, std::string& str) const; // Serializes a section, including its header
+        std::string buildValueString(const std::string& name, const std::string& section, const Option& option) const; // Returns the value as it is written to files
+
+        // Interpolation
+        void updateInterpolation(const std::string& name, const std::string& section, Option& option); // Called when an option changes, to find its references
+        void resolveInterpolation(); // Resolves the templates that need to be updated
+
+        // Change callbacks
+        using CallbackList = std::vector<std::pair<unsigned, ChangeCallback>>;
+        struct Watchers
+        {
+            CallbackList sectionCallbacks; // Called for every option in the section
+            std::unordered_map<std::string, CallbackList> optionCallbacks;
+        };
+        bool isWatched(const std::string& name, const std::string& section) const; // Returns true if any callbacks would be called for an option
+        void callWatchers(const std::string& name, const std::string& section, const Option& oldValue, const Option& newValue); // Calls the callbacks if the value changed
+        void assignOption(const std::string& name, const std::string& section, const Option& value); // Copies a value into an option, and calls the callbacks
+        void attachTelemetry(); // Gives counters to any options that don't have them yet, if telemetry is enabled
+
         // Objects/variables
         ConfigMap options; // The data structure for storing all of the options in memory
+        SectionTree sectionTree; // Index of the sections in the map by their paths
         std::string configFilename; // The filename of the config file to read/write to
         std::string currentSection; // The default current section
         int flags; // Flag bits are stored in here
         mutable bool fileIoSuccessful;
 
+        // Parsing limits
+        ParseLimits parseLimits;
+        std::string parseError; // Why the last load stopped early, if it did
+        size_t parsedOptions{}; // Options and array elements read so far (only counted with a limit)
+
         // Array related objects
-        std::vector<unsigned> currentArrayStack; // Stack of array indices for current option
+        std::vector<Option*> arrayStack; // Stack of the arrays that are currently open (the innermost is last)
         std::string arrayOptionName; // Name of option whose array is currently being handled
+
+        // Change tracking objects
+        mutable std::uint64_t savedRevision{}; // Latest revision that was loaded/saved
+        mutable std::map<std::string, size_t> savedSizes; // Number of options in each section when last loaded/saved
+        AutosaveWorker autosave;
+
+        // Change callback objects
+        std::unordered_map<std::string, Watchers> watchers; // Callbacks by section, then by option
+        std::unordered_map<unsigned, std::pair<std::string, std::string>> callbackNames; // Option name and section of each callback (the name is empty for sections)
+        unsigned lastCallbackId{};
+
+        std::shared_ptr<StringPool> stringPool; // Pool for the text of loaded strings, if any
+        Telemetry telemetry; // Counters of the options, when telemetry is enabled
+        Interpolation interpolation; // Templates of options with references, only used with the Interpolate flag
+        Option arrayOldValue; // Value of the array being parsed before it was loaded
+        bool arrayWatched{}; // True if arrayOldValue needs to be compared when the array is closed
+
+        // Layout related objects
+        mutable Layout layout; // Where everything was in the last loaded source
+        mutable TextCache textCache; // Serialized sections from the last writeToString
+        std::vector<size_t> lineOffsets; // Offset of each line while parsing, only used when recording the layout
+        size_t currentLine{}; // Index of the line being parsed
+        size_t arrayFirstLine{}; // Line where the current array started
+        size_t arrayValueBegin{}; // Offset where the current array started
 };
 
+template <typename Type>
+bool File::set(const std::string& name, const std::string& section, const Type& value)
+{
+    Option& option = (*this)(name, section);
+    if (!isWatched(name, section) && !(flags & Interpolate))
+        return (option = value);
+    Option oldValue(option);
+    bool status = (option = value);
+    callWatchers(name, section, oldValue, option);
+    if (flags & Interpolate)
+    {
+        updateInterpolation(name, section, option);
+        resolveInterpolation();
+    }
+    return status;
+}
+
+template <typename Function>
+void File::forEachWithPrefix(std::string_view prefix, std::string_view section, Function function) const
+{
+    const Section* sectionFound = findSection(section);
+    if (sectionFound)
+    {
+        auto range = findPrefix(*sectionFound, prefix);
+        for (auto it = range.first; it != range.second; ++it)
+            function(it->first, it->second);
+    }
+}
+
+template <typename Function>
+void File::forEachSectionWithPrefix(std::string_view prefix, Function function) const
+{
+    auto range = findPrefix(options, prefix);
+    for (auto it = range.first; it != range.second; ++it)
+        function(it->first, it->second);
+}
+
+template <typename Map>
+std::pair<typename Map::const_iterator, typename Map::const_iterator> File::findPrefix(const Map& map, std::string_view prefix)
+{
+    // The keys are sorted, so the matches start at the prefix and are all next to each other
+    auto first = map.lower_bound(prefix);
+    auto last = first;
+    while (last != map.end() && last->first.compare(0, prefix.size(), prefix) == 0)
+        ++last;
+    return {first, last};
+}
+
+template <typename Type>
+Type File::get(std::string_view name, std::string_view section, const Type& defaultValue) const
+{
+    const Option* option = find(name, section);
+    if (!option)
+        return defaultValue;
+    Type value;
+    option->get(value);
+    return value;
+}
+
 }
 
 #endif
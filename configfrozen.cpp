@@ -0,0 +1,208 @@
+// Copyright (C) 2014-2016 Eric Hebert (ayebear)
+// This code is licensed under MIT, see LICENSE.txt for details.
+
+#include "configfrozen.h"
+#include <algorithm>
+#include <utility>
+#include "configfile.h"
+
+namespace cfg
+{
+
+namespace
+{
+
+// Spreads the bits of a hash, so nearby values end up far apart (the finalizer of SplitMix64)
+std::uint64_t mix(std::uint64_t value)
+{
+    value ^= value >> 30;
+    value *= 0xbf58476d1ce4e5b9ULL;
+    value ^= value >> 27;
+    value *= 0x94d049bb133111ebULL;
+    value ^= value >> 31;
+    return value;
+}
+
+// FNV-1a
+void hashText(std::uint64_t& hash, std::string_view str)
+{
+    for (char c: str)
+    {
+        hash ^= static_cast<unsigned char>(c);
+        hash *= 0x100000001b3ULL;
+    }
+}
+
+}
+
+const Option FrozenFile::emptyOption;
+
+FrozenFile::FrozenFile()
+{
+}
+
+FrozenFile::FrozenFile(const File& file)
+{
+    std::vector<std::pair<const std::string*, const File::Section::value_type*>> sources;
+    for (const auto& section: file.options)
+    {
+        for (const auto& option: section.second)
+            sources.emplace_back(&section.first, &option);
+    }
+    if (sources.empty())
+        return;
+
+    // A different seed is tried in the rare case where some hashes can't be placed
+    std::vector<std::uint64_t> hashes(sources.size());
+    std::vector<std::uint32_t> slots;
+    while (true)
+    {
+        for (size_t i = 0; i < sources.size(); ++i)
+            hashes[i] = getHash(sources[i].second->first, *sources[i].first, seed);
+        if (buildSlots(hashes, slots))
+            break;
+        ++seed;
+    }
+
+    // Store the entries in slot order
+    std::vector<std::uint32_t> order(sources.size());
+    for (size_t i = 0; i < sources.size(); ++i)
+        order[slots[i]] = i;
+    entries.reserve(sources.size());
+    values.reserve(sources.size());
+    for (auto i: order)
+    {
+        const std::string& section = *sources[i].first;
+        const std::string& name = sources[i].second->first;
+        entries.push_back({hashes[i], static_cast<std::uint32_t>(keys.size()), static_cast<std::uint32_t>(section.size()),
+            static_cast<std::uint32_t>(name.size())});
+        values.push_back(sources[i].second->second);
+        prepareForReaders(values.back());
+        keys += section;
+        keys += name;
+    }
+}
+
+const Option* FrozenFile::find(std::string_view name, std::string_view section) const
+{
+    if (entries.empty())
+        return nullptr;
+    std::uint64_t hash = getHash(name, section, seed);
+    size_t slot = getSlot(hash);
+    const Entry& entry = entries[slot];
+    if (entry.hash != hash || entry.sectionSize != section.size() || entry.nameSize != name.size())
+        return nullptr;
+    std::string_view key(keys.data() + entry.keyOffset, entry.sectionSize + entry.nameSize);
+    if (key.substr(0, entry.sectionSize) != section || key.substr(entry.sectionSize) != name)
+        return nullptr;
+    return &values[slot];
+}
+
+const Option& FrozenFile::operator()(std::string_view name, std::string_view section) const
+{
+    const Option* option = find(name, section);
+    return (option ? *option : emptyOption);
+}
+
+std::string FrozenFile::get(std::string_view name, std::string_view section, const char* defaultValue) const
+{
+    const Option* option = find(name, section);
+    return (option ? option->toString() : defaultValue);
+}
+
+bool FrozenFile::optionExists(std::string_view name, std::string_view section) const
+{
+    return (find(name, section) != nullptr);
+}
+
+size_t FrozenFile::size() const
+{
+    return entries.size();
+}
+
+std::uint64_t FrozenFile::getHash(std::string_view name, std::string_view section, std::uint64_t seed)
+{
+    // The section size is included, so moving characters between the names changes the hash
+    std::uint64_t hash = 0xcbf29ce484222325ULL ^ mix(seed + section.size());
+    hashText(hash, section);
+    hashText(hash, name);
+    return mix(hash);
+}
+
+size_t FrozenFile::getSlot(std::uint64_t hash) const
+{
+    // The upper bits pick the bucket, and the displacement of the bucket picks the slot
+    std::uint32_t displacement = displacements[(hash >> 32) % displacements.size()];
+    return mix(hash + displacement * 0x9e3779b97f4a7c15ULL) % entries.size();
+}
+
+void FrozenFile::prepareForReaders(Option& option)
+{
+    // Numbers set from code create their text when it is first read, and numeric arrays create
+    // their elements when they are first iterated over, so all of that is done before any threads read it
+    option.toString();
+    if (option.isNumericArray())
+    {
+        for (auto it = std::as_const(option).cbegin(); it != option.cend(); ++it)
+            it->toString();
+    }
+    else
+    {
+        for (auto& element: option)
+            prepareForReaders(element);
+    }
+}
+
+bool FrozenFile::buildSlots(const std::vector<std::uint64_t>& hashes, std::vector<std::uint32_t>& slots)
+{
+    // Each bucket has about 4 hashes, and the largest buckets are placed first while there are many free slots
+    size_t count = hashes.size();
+    displacements.assign((count + 3) / 4, 0);
+    std::vector<std::vector<std::uint32_t>> buckets(displacements.size());
+    for (size_t i = 0; i < count; ++i)
+        buckets[(hashes[i] >> 32) % buckets.size()].push_back(i);
+    std::vector<std::uint32_t> bucketOrder(buckets.size());
+    for (size_t i = 0; i < buckets.size(); ++i)
+        bucketOrder[i] = i;
+    std::stable_sort(bucketOrder.begin(), bucketOrder.end(),
+        [&buckets](std::uint32_t a, std::uint32_t b){ return buckets[a].size() > buckets[b].size(); });
+
+    // Try displacements until every hash in the bucket lands in a different free slot
+    // The last buckets take about "count" tries each, so the limit is only reached if two hashes are the same
+    const size_t maxTries = count * 16 + 1024;
+    std::vector<bool> used(count);
+    std::vector<std::uint32_t> bucketSlots;
+    slots.assign(count, 0);
+    for (auto bucket: bucketOrder)
+    {
+        if (buckets[bucket].empty())
+            break;
+        bool placed = false;
+        for (size_t displacement = 0; displacement < maxTries && !placed; ++displacement)
+        {
+            bucketSlots.clear();
+            for (auto i: buckets[bucket])
+            {
+                size_t slot = mix(hashes[i] + displacement * 0x9e3779b97f4a7c15ULL) % count;
+                if (used[slot] || std::find(bucketSlots.begin(), bucketSlots.end(), slot) != bucketSlots.end())
+                    break;
+                bucketSlots.push_back(slot);
+            }
+            if (bucketSlots.size() == buckets[bucket].size())
+            {
+                displacements[bucket] = static_cast<std::uint32_t>(displacement);
+                for (size_t i = 0; i < bucketSlots.size(); ++i)
+                {
+                    used[bucketSlots[i]] = true;
+                    slots[buckets[bucket][i]] = bucketSlots[i];
+                }
+                placed = true;
+            }
+        }
+        if (!placed)
+            return false;
+    }
+    return true;
+}
+
+}
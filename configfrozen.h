@@ -0,0 +1,80 @@
+// Copyright (C) 2014-2016 Eric Hebert (ayebear)
+// This code is licensed under MIT, see LICENSE.txt for details.
+
+#ifndef CFG_FROZEN_H
+#define CFG_FROZEN_H
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "configoption.h"
+
+namespace cfg
+{
+
+class File;
+
+/*
+A read-only copy of the options in a file, made for fast lookups.
+A minimal perfect hash (made with the "hash, displace, and compress" method) maps every
+option to its own slot, so a lookup is one hash, one displacement, and one comparison.
+The slots only hold the hashes and where the names are, so the slot of a lookup fits in one
+cache line, and the options are stored in a separate array in the same order. This can't be
+changed, so to change the options, change the file and freeze it again. Every value (including
+array elements) is converted to text when freezing, so reading from multiple threads is safe.
+*/
+class FrozenFile
+{
+    public:
+        FrozenFile(); // Makes an empty copy
+        explicit FrozenFile(const File& file); // Copies all of the options in a file
+
+        const Option* find(std::string_view name, std::string_view section) const; // Returns an option, or null if it does not exist
+        const Option& operator()(std::string_view name, std::string_view section) const; // Returns an option, or an empty option if it does not exist
+        template <typename Type>
+        Type get(std::string_view name, std::string_view section, const Type& defaultValue) const; // Returns the value of an option, or the default value
+        std::string get(std::string_view name, std::string_view section, const char* defaultValue) const; // Same as above, for string literals
+        bool optionExists(std::string_view name, std::string_view section) const; // Returns true if an option exists
+        size_t size() const; // Returns the number of options
+
+    private:
+        struct Entry
+        {
+            std::uint64_t hash; // Checked first, so most missing options never compare the text
+            std::uint32_t keyOffset; // The section name is followed by the option name in "keys"
+            std::uint32_t sectionSize;
+            std::uint32_t nameSize;
+        };
+
+        static std::uint64_t getHash(std::string_view name, std::string_view section, std::uint64_t seed);
+        size_t getSlot(std::uint64_t hash) const; // Returns where an option with this hash would be stored
+
+        // Tries to place every hash into its own slot, returns false if a bucket could not be placed
+        bool buildSlots(const std::vector<std::uint64_t>& hashes, std::vector<std::uint32_t>& slots);
+
+        static void prepareForReaders(Option& option); // Creates everything that is otherwise made when it is first read
+
+        std::vector<Entry> entries; // One for each option, in slot order
+        std::vector<Option> values; // The options of the entries, in the same order
+        std::vector<std::uint32_t> displacements; // One for each bucket of hashes
+        std::string keys; // Text of all of the section and option names
+        std::uint64_t seed{};
+
+        static const Option emptyOption;
+};
+
+template <typename Type>
+Type FrozenFile::get(std::string_view name, std::string_view section, const Type& defaultValue) const
+{
+    const Option* option = find(name, section);
+    if (!option)
+        return defaultValue;
+    Type value;
+    option->get(value);
+    return value;
+}
+
+}
+
+#endif
@@ -0,0 +1,212 @@
+// Copyright (C) 2014-2016 Eric Hebert (ayebear)
+// This code is licensed under MIT, see LICENSE.txt for details.
+
+#include "configinterpolation.h"
+#include "configfile.h"
+#include "strlib.h"
+
+namespace cfg
+{
+
+bool Interpolation::empty() const
+{
+    return templates.empty();
+}
+
+void Interpolation::clear()
+{
+    templates.clear();
+    dependents.clear();
+    pending.clear();
+}
+
+void Interpolation::update(const std::string& name, const std::string& section, const std::string& text, bool quotes, bool escapes)
+{
+    auto references = findReferences(text, section);
+    if (references.empty() && templates.empty() && dependents.empty())
+        return; // Nothing to do, which is the common case while loading
+
+    std::string key = makeKey(name, section);
+    removeTemplate(key);
+    if (!references.empty())
+    {
+        // The template uses these options, so it needs to be resolved again when they change
+        for (const auto& reference: references)
+            dependents[reference.key].insert(key);
+        Template& newTemplate = templates[key];
+        newTemplate.name = name;
+        newTemplate.section = section;
+        newTemplate.text = text;
+        newTemplate.output = (quotes ? '"' + (escapes ? strlib::escape(text) : text) + '"' : text);
+        newTemplate.quotes = quotes;
+        newTemplate.references = std::move(references);
+        pending.insert(key);
+    }
+    addPendingDependents(key);
+}
+
+void Interpolation::erase(const std::string& name, const std::string& section)
+{
+    if (templates.empty() && dependents.empty())
+        return;
+    std::string key = makeKey(name, section);
+    removeTemplate(key);
+    addPendingDependents(key);
+}
+
+const std::string* Interpolation::findTemplate(const std::string& name, const std::string& section, const Option& option) const
+{
+    auto templateFound = templates.find(makeKey(name, section));
+    if (templateFound == templates.end())
+        return nullptr;
+    const Template& found = templateFound->second;
+    if (found.revision && option.getRevision() > found.revision)
+        return nullptr; // Overridden, so the new value is written instead
+    return &found.output;
+}
+
+bool Interpolation::resolve(File& file)
+{
+    if (pending.empty())
+        return true;
+
+    // Anything using a pending template has to be resolved after it
+    std::vector<std::string> keys(pending.begin(), pending.end());
+    for (size_t i = 0; i < keys.size(); ++i)
+    {
+        auto dependentsFound = dependents.find(keys[i]);
+        if (dependentsFound != dependents.end())
+        {
+            for (const auto& dependent: dependentsFound->second)
+            {
+                if (pending.insert(dependent).second)
+                    keys.push_back(dependent);
+            }
+        }
+    }
+
+    // Each template is only resolved once, after the templates it uses
+    std::unordered_map<std::string, State> states;
+    bool status = true;
+    for (const auto& key: keys)
+        status = resolve(file, key, states) && status;
+    pending.clear();
+    return status;
+}
+
+std::string Interpolation::makeKey(const std::string& name, const std::string& section)
+{
+    // Names can't have new lines, since they are read one line at a time
+    return section + '\n' + name;
+}
+
+std::vector<Interpolation::Reference> Interpolation::findReferences(const std::string& text, const std::string& section)
+{
+    std::vector<Reference> references;
+    for (size_t begin = text.find("${"); begin != std::string::npos; begin = text.find("${", begin + 2))
+    {
+        size_t end = text.find('}', begin + 2);
+        if (end == std::string::npos)
+            break;
+        std::string path = text.substr(begin + 2, end - begin - 2);
+        size_t dot = path.rfind('.'); // Sections can have dots too, so the name is after the last one
+        if (dot == std::string::npos)
+            references.push_back({begin, end + 1, makeKey(path, section)});
+        else
+            references.push_back({begin, end + 1, makeKey(path.substr(dot + 1), path.substr(0, dot))});
+    }
+    return references;
+}
+
+void Interpolation::removeTemplate(const std::string& key)
+{
+    auto templateFound = templates.find(key);
+    if (templateFound == templates.end())
+        return;
+    for (const auto& reference: templateFound->second.references)
+    {
+        auto dependentsFound = dependents.find(reference.key);
+        if (dependentsFound != dependents.end())
+        {
+            dependentsFound->second.erase(key);
+            if (dependentsFound->second.empty())
+                dependents.erase(dependentsFound);
+        }
+    }
+    templates.erase(templateFound);
+    pending.erase(key);
+}
+
+void Interpolation::addPendingDependents(const std::string& key)
+{
+    auto dependentsFound = dependents.find(key);
+    if (dependentsFound != dependents.end())
+        pending.insert(dependentsFound->second.begin(), dependentsFound->second.end());
+}
+
+bool Interpolation::resolve(File& file, const std::string& key, std::unordered_map<std::string, State>& states)
+{
+    // Plain options, and templates that did not need to change, already have their values
+    auto templateFound = templates.find(key);
+    if (templateFound == templates.end() || pending.count(key) == 0)
+        return true;
+    auto stateFound = states.find(key);
+    if (stateFound != states.end())
+        return (stateFound->second == State::Resolved); // Still resolving means there is a cycle
+    states[key] = State::Resolving;
+
+    // An option that was changed directly since it was resolved keeps its value, and stops being a template
+    Template& current = templateFound->second;
+    if (current.revision)
+    {
+        const Option* overridden = file.find(current.name, current.section);
+        if (overridden && overridden->getRevision() > current.revision)
+        {
+            removeTemplate(key);
+            states[key] = State::Resolved;
+            return true;
+        }
+    }
+
+    bool status = true;
+    for (const auto& reference: current.references)
+        status = resolve(file, reference.key, states) && status;
+    if (!status)
+    {
+        states[key] = State::Failed;
+        return false;
+    }
+
+    // Replace each reference with the value it points to, missing options are left as-is
+    std::string value;
+    size_t pos = 0;
+    for (const auto& reference: current.references)
+    {
+        value.append(current.text, pos, reference.begin - pos);
+        size_t split = reference.key.find('\n');
+        const Option* option = file.find(std::string_view(reference.key).substr(split + 1),
+            std::string_view(reference.key).substr(0, split));
+        if (option)
+            value += option->toString();
+        else
+            value.append(current.text, reference.begin, reference.end - reference.begin);
+        pos = reference.end;
+    }
+    value.append(current.text, pos, std::string::npos);
+
+    Option& option = file.findOrAddSection(current.section)[current.name];
+    bool watched = file.isWatched(current.name, current.section);
+    Option oldValue;
+    if (watched)
+        oldValue = option;
+    option = value;
+    if (current.quotes)
+        option.setQuotes(true);
+    current.revision = option.getRevision();
+    if (watched)
+        file.callWatchers(current.name, current.section, oldValue, option);
+    states[key] = State::Resolved;
+    return true;
+}
+
+}
@@ -0,0 +1,85 @@
+// Copyright (C) 2014-2016 Eric Hebert (ayebear)
+// This code is licensed under MIT, see LICENSE.txt for details.
+
+#ifndef CFG_INTERPOLATION_H
+#define CFG_INTERPOLATION_H
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace cfg
+{
+
+class File;
+class Option;
+
+/*
+Replaces references like "${Section.option}" in values with the values of other options.
+The text with the references (the template) is kept here, and the option holds the resolved value.
+Each template remembers which options it uses, so only the templates that depend on a changed option
+are resolved again. A reference without a section, like "${option}", uses the same section.
+Options that are changed directly (not through the file) after being resolved keep their new values,
+so their templates are dropped.
+*/
+class Interpolation
+{
+    public:
+        bool empty() const; // Returns true if there are no templates
+        void clear();
+
+        // Called when an option was set to "text", which is a template if it has any references
+        // With "escapes", the template is saved with escape codes
+        void update(const std::string& name, const std::string& section, const std::string& text, bool quotes, bool escapes);
+        void erase(const std::string& name, const std::string& section); // Called when an option was erased
+
+        // Returns the template of an option as it is written to files, or null if it is not a template
+        // Also returns null if the option was changed after it was resolved
+        const std::string* findTemplate(const std::string& name, const std::string& section, const Option& option) const;
+
+        // Resolves the templates that were added, or that use options that changed
+        // Returns false if any templates reference themselves (those are left unresolved)
+        bool resolve(File& file);
+
+    private:
+        struct Reference
+        {
+            size_t begin; // Position of "${"
+            size_t end; // Position after "}"
+            std::string key; // Key of the referenced option
+        };
+
+        struct Template
+        {
+            std::string name;
+            std::string section;
+            std::string text; // The value with the references
+            std::string output; // The value as it is written to files (with quotes if needed)
+            bool quotes{};
+            std::vector<Reference> references;
+            std::uint64_t revision{}; // Revision of the option when it was resolved (zero until then)
+        };
+
+        enum class State
+        {
+            Resolving,
+            Resolved,
+            Failed
+        };
+
+        static std::string makeKey(const std::string& name, const std::string& section);
+        static std::vector<Reference> findReferences(const std::string& text, const std::string& section);
+        void removeTemplate(const std::string& key); // Removes a template and its dependencies
+        void addPendingDependents(const std::string& key); // Marks the templates using an option as needing to be resolved
+        bool resolve(File& file, const std::string& key, std::unordered_map<std::string, State>& states);
+
+        std::unordered_map<std::string, Template> templates; // Templates by option key
+        std::unordered_map<std::string, std::unordered_set<std::string>> dependents; // Keys of the templates using each option
+        std::unordered_set<std::string> pending; // Keys of the templates that need to be resolved
+};
+
+}
+
+#endif
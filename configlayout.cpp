@@ -0,0 +1,271 @@
+// Copyright (C) 2014-2016 Eric Hebert (ayebear)
+// This code is licensed under MIT, see LICENSE.txt for details.
+
+#include "configlayout.h"
+#include <algorithm>
+#include <fstream>
+#include "configfile.h"
+#include "strlib.h"
+
+namespace cfg
+{
+
+void Layout::reset(const std::string& source, std::vector<size_t> lineOffsets)
+{
+    clear();
+    this->source = source;
+    offsets = std::move(lineOffsets);
+    recorded = true;
+}
+
+void Layout::clear()
+{
+    source.clear();
+    offsets.clear();
+    sections.clear();
+    lastSection.clear();
+    recorded = false;
+}
+
+bool Layout::empty() const
+{
+    return !recorded;
+}
+
+void Layout::recordSection(const std::string& section, size_t line)
+{
+    // The previous block ends where this header starts
+    auto& previous = sections[lastSection];
+    if (previous.blockEnds.size() < previous.headers.size())
+        previous.blockEnds.push_back(lineBegin(line));
+
+    auto& span = sections[section];
+    span.headers.push_back(lineBegin(line));
+    if (span.options.empty())
+        span.insertPos = lineEnd(line);
+    lastSection = section;
+}
+
+void Layout::recordOption(const std::string& section, const std::string& name,
+    size_t firstLine, size_t lastLine, size_t valueBegin, size_t valueEnd)
+{
+    auto& sectionSpan = sections[section];
+    auto& span = sectionSpan.options[name];
+    span.lines.push_back(lineBegin(firstLine));
+    span.lineEnds.push_back(lineEnd(lastLine));
+    span.valueBegin = valueBegin;
+    span.valueEnd = valueEnd;
+    sectionSpan.insertPos = std::max(sectionSpan.insertPos, lineEnd(lastLine));
+}
+
+void Layout::finish(const File& file)
+{
+    // Close the last block
+    auto& last = sections[lastSection];
+    if (last.blockEnds.size() < last.headers.size())
+        last.blockEnds.push_back(source.size());
+
+    // Remember what each option looked like after loading
+    recordValues(file);
+}
+
+void Layout::recordValues(const File& file)
+{
+    for (auto& section: sections)
+    {
+        auto sectionFound = file.options.find(section.first);
+        for (auto& option: section.second.options)
+        {
+            if (sectionFound != file.options.end())
+            {
+                auto optionFound = sectionFound->second.find(option.first);
+                if (optionFound != sectionFound->second.end())
+                    option.second.value = file.buildValueString(option.first, section.first, optionFound->second);
+            }
+        }
+    }
+}
+
+bool Layout::buildPatched(const File& file, std::string& output) const
+{
+    std::vector<Patch> patches;
+    buildPatches(file, patches);
+    output = source;
+    applyPatches(patches, output);
+    return !patches.empty();
+}
+
+bool Layout::write(const File& file, const std::string& filename, bool isSource)
+{
+    std::vector<Patch> patches;
+    buildPatches(file, patches);
+    if (isSource && patches.empty())
+        return true; // Nothing changed, so there is nothing to write
+
+    bool sameSize = std::all_of(patches.begin(), patches.end(),
+        [](const Patch& patch){ return patch.text.size() == patch.end - patch.begin; });
+
+    if (isSource && sameSize)
+    {
+        // Only overwrite the bytes that changed
+        std::fstream outFile(filename, std::fstream::in | std::fstream::out | std::fstream::binary);
+        if (!outFile.is_open())
+            return false;
+        for (const auto& patch: patches)
+        {
+            outFile.seekp(patch.begin);
+            outFile.write(patch.text.data(), patch.text.size());
+            source.replace(patch.begin, patch.text.size(), patch.text);
+        }
+        outFile.close();
+        if (!outFile)
+            return false;
+
+        // Only the values changed, so the spans are all still valid
+        // The values are compared in the same form as when loading, so untouched options are not patched again
+        recordValues(file);
+        return true;
+    }
+
+    // Otherwise, the whole patched source needs to be written
+    std::string output(source);
+    applyPatches(patches, output);
+    bool status = strlib::writeStringToFile(filename, output);
+    if (status && isSource)
+    {
+        // Record the new source, so that the next write is relative to what is in the file now
+        // It uses the same flags (except for autosaving), so templates are recorded the same way
+        File scratch;
+        scratch.setFlags((file.flags & ~File::Autosave) | File::PreserveLayout);
+        scratch.loadFromString(output);
+        *this = std::move(scratch.layout);
+    }
+    return status;
+}
+
+void Layout::buildPatches(const File& file, std::vector<Patch>& patches) const
+{
+    for (const auto& section: sections)
+    {
+        auto sectionFound = file.options.find(section.first);
+        if (sectionFound == file.options.end())
+        {
+            // Erase every block that belonged to this section
+            const auto& headers = section.second.headers;
+            const auto& blockEnds = section.second.blockEnds;
+            for (unsigned i = 0; i < headers.size(); ++i)
+                patches.push_back({headers[i], blockEnds[i], ""});
+
+            // Options that were not inside of those blocks (default section) still need to be removed
+            for (const auto& option: section.second.options)
+            {
+                for (unsigned i = 0; i < option.second.lines.size(); ++i)
+                {
+                    size_t pos = option.second.lines[i];
+                    bool inBlock = false;
+                    for (unsigned j = 0; !inBlock && j < headers.size(); ++j)
+                        inBlock = (pos >= headers[j] && pos < blockEnds[j]);
+                    if (!inBlock)
+                        patches.push_back({pos, option.second.lineEnds[i], ""});
+                }
+            }
+            continue;
+        }
+
+        // Update or erase the options that were in the source
+        for (const auto& option: section.second.options)
+        {
+            auto optionFound = sectionFound->second.find(option.first);
+            if (optionFound == sectionFound->second.end())
+            {
+                for (unsigned i = 0; i < option.second.lines.size(); ++i)
+                    patches.push_back({option.second.lines[i], option.second.lineEnds[i], ""});
+            }
+            else
+            {
+                auto value = file.buildValueString(option.first, section.first, optionFound->second);
+                if (value != option.second.value)
+                    patches.push_back({option.second.valueBegin, option.second.valueEnd, std::move(value)});
+            }
+        }
+
+        // Insert options that were not in the source
+        std::string added;
+        for (const auto& option: sectionFound->second)
+        {
+            if (section.second.options.find(option.first) == section.second.options.end())
+                added += option.first + " = " + file.buildValueString(option.first, section.first, option.second) + '\n';
+        }
+        if (!added.empty())
+        {
+            size_t pos = section.second.insertPos;
+            if (pos > 0 && source[pos - 1] != '\n' && source[pos - 1] != '\r')
+                added.insert(0, 1, '\n');
+            patches.push_back({pos, pos, std::move(added)});
+        }
+    }
+
+    // Add the sections that were not in the source
+    std::string added;
+    for (const auto& section: file.options)
+    {
+        if (sections.find(section.first) == sections.end())
+        {
+            std::string sectionStr;
+            for (const auto& o: section.second)
+                sectionStr += o.first + " = " + file.buildValueString(o.first, section.first, o.second) + '\n';
+            if (section.first.empty())
+            {
+                // Options in the default section must come before any section headers
+                if (!sectionStr.empty())
+                    patches.push_back({0, 0, sectionStr + '\n'});
+            }
+            else
+                added += "\n[" + section.first + "]\n" + sectionStr;
+        }
+    }
+    if (!added.empty())
+    {
+        // Options inserted at the end of the source already started a new line
+        bool terminated = std::any_of(patches.begin(), patches.end(),
+            [&](const Patch& patch){ return patch.begin == source.size(); });
+        if (!terminated && !source.empty() && source.back() != '\n' && source.back() != '\r')
+            added.insert(0, 1, '\n');
+        patches.push_back({source.size(), source.size(), std::move(added)});
+    }
+
+    // Insertions come before removals that start at the same position
+    std::stable_sort(patches.begin(), patches.end(), [](const Patch& a, const Patch& b)
+        { return (a.begin != b.begin ? a.begin < b.begin : a.end < b.end); });
+}
+
+void Layout::applyPatches(const std::vector<Patch>& patches, std::string& output) const
+{
+    if (patches.empty())
+        return;
+
+    // Build the output in one pass, copying the untouched bytes between patches
+    std::string patched;
+    patched.reserve(source.size());
+    size_t pos{0};
+    for (const auto& patch: patches)
+    {
+        patched.append(source, pos, patch.begin - pos);
+        patched += patch.text;
+        pos = patch.end;
+    }
+    patched.append(source, pos, std::string::npos);
+    output = std::move(patched);
+}
+
+size_t Layout::lineBegin(size_t line) const
+{
+    return (line < offsets.size() ? offsets[line] : source.size());
+}
+
+size_t Layout::lineEnd(size_t line) const
+{
+    return lineBegin(line + 1);
+}
+
+}
@@ -0,0 +1,82 @@
+// Copyright (C) 2014-2016 Eric Hebert (ayebear)
+// This code is licensed under MIT, see LICENSE.txt for details.
+
+#ifndef CFG_LAYOUT_H
+#define CFG_LAYOUT_H
+
+#include <map>
+#include <vector>
+#include <string>
+
+namespace cfg
+{
+
+class File;
+
+/*
+Remembers where each section and option came from in the last loaded source,
+so that edits can be written back as small byte-range patches.
+Everything that was not changed (comments, ordering, whitespace) is kept as-is.
+*/
+class Layout
+{
+    public:
+        // Forgets everything, and starts recording a new source
+        void reset(const std::string& source, std::vector<size_t> lineOffsets);
+        void clear();
+        bool empty() const;
+
+        // Called by the parser while loading
+        void recordSection(const std::string& section, size_t line); // A section header was found on this line
+        void recordOption(const std::string& section, const std::string& name,
+            size_t firstLine, size_t lastLine, size_t valueBegin, size_t valueEnd); // An option was read from these lines
+        void finish(const File& file); // Remembers the loaded values, so only changed options are patched later
+
+        // Builds the patched source from the current options, returns false if nothing changed
+        bool buildPatched(const File& file, std::string& output) const;
+
+        // Writes the changes to a file, patching it in place when the size of the file stays the same
+        // If "filename" is not the recorded source, the whole patched source is written there instead
+        bool write(const File& file, const std::string& filename, bool isSource);
+
+    private:
+        struct Patch
+        {
+            size_t begin;
+            size_t end;
+            std::string text;
+        };
+
+        struct OptionSpan
+        {
+            std::vector<size_t> lines; // Beginning of each line range that defined this option (duplicates included)
+            std::vector<size_t> lineEnds;
+            size_t valueBegin{}; // Span of the value that is actually used (the last one)
+            size_t valueEnd{};
+            std::string value; // The value as it was last loaded/written
+        };
+
+        struct SectionSpan
+        {
+            std::vector<size_t> headers; // Beginning of each header line for this section
+            std::vector<size_t> blockEnds; // End of each block that started with a header
+            size_t insertPos{}; // New options are inserted here
+            std::map<std::string, OptionSpan> options;
+        };
+
+        void recordValues(const File& file); // Remembers the current value of each option in the layout
+        void buildPatches(const File& file, std::vector<Patch>& patches) const;
+        void applyPatches(const std::vector<Patch>& patches, std::string& output) const;
+        size_t lineBegin(size_t line) const;
+        size_t lineEnd(size_t line) const;
+
+        std::string source; // The text that was last loaded or written
+        std::vector<size_t> offsets; // Offset of each line in the source
+        std::map<std::string, SectionSpan> sections;
+        std::string lastSection; // Used to find the ends of section blocks
+        bool recorded{};
+};
+
+}
+
+#endif
@@ -2,11 +2,13 @@
 // This code is licensed under MIT, see LICENSE.txt for details.
 
 #include "configoption.h"
+#include <algorithm>
 
 namespace cfg
 {
 
 Option::OptionVector Option::emptyVector;
+std::atomic<std::uint64_t> Option::revisionCounter{0};
 
 Option::Option(const std::string& data)
 {
@@ -18,10 +20,37 @@ Option::Option(const Option& data)
     operator=(data);
 }
 
+Option::Option(const EmbeddedValue& data):
+    text(data.text, data.textSize),
+    integer(data.integer),
+    decimal(data.decimal),
+    boolean(data.boolean),
+    quotes(data.quotes)
+{
+    if (data.elementCount > 0)
+    {
+        options = std::make_unique<OptionVector>();
+        options->reserve(data.elementCount);
+        for (unsigned i = 0; i < data.elementCount; ++i)
+            options->emplace_back(data.elements[i]);
+        pack(); // Numeric arrays are stored the same way as when they are loaded
+    }
+}
+
+Option::~Option()
+{
+    // Erasing an option also changes its section (revisions are never zero)
+    if (parentRevision)
+        *parentRevision = 0;
+    if (counter)
+        counter->release(); // So a new option can use it
+}
+
 void Option::reset()
 {
     removeRange();
     options.reset();
+    numbers.reset();
     operator=(0);
 }
 
@@ -38,6 +67,8 @@ bool Option::operator=(const std::string& data)
 Option& Option::operator=(const Option& data)
 {
     text = data.text;
+    sharedText = data.sharedText;
+    pendingText = data.pendingText;
     integer = data.integer;
     decimal = data.decimal;
     boolean = data.boolean;
@@ -46,20 +77,25 @@ Option& Option::operator=(const Option& data)
     maxEnabled = data.maxEnabled;
     rangeMin = data.rangeMin;
     rangeMax = data.rangeMax;
-    if (data.options)
+    if (data.options && !data.numbers)
         options = std::make_unique<OptionVector>(*data.options);
     else
         options.reset();
+    if (data.numbers)
+        numbers = std::make_unique<NumericArray>(*data.numbers);
+    else
+        numbers.reset();
+    trackElements();
+    touch();
     return *this;
 }
 
 bool Option::setString(const std::string& data)
 {
-    std::istringstream stream(data);
     double value{};
 
-    // Try to parse a value from the string
-    bool success = (stream >> value) && (static_cast<size_t>(stream.gcount()) == data.size());
+    // Try to parse a value from the string (it must use up the whole string)
+    bool success = strlib::fromChars(data, value);
 
     // Only set the value if it's in range
     if (isInRange(value))
@@ -67,11 +103,12 @@ bool Option::setString(const std::string& data)
         decimal = value;
         integer = decimal;
         text = data;
+        sharedText.reset();
+        pendingText = PendingText::None;
 
         // Check for a boolean value
-        auto lowerStr = strlib::toLower(data);
-        bool isTrue = (lowerStr == "true");
-        bool isFalse = (lowerStr == "false");
+        bool isTrue = strlib::iequals(data, "true");
+        bool isFalse = strlib::iequals(data, "false");
 
         // Determine if quotes are necessary
         quotes = !(success || isFalse || isTrue);
@@ -79,6 +116,7 @@ bool Option::setString(const std::string& data)
         // Convert to a boolean ("true" means true, or any non-zero value)
         boolean = (success ? (decimal != 0) : isTrue);
 
+        touch();
         return true;
     }
     return false;
@@ -86,76 +124,101 @@ bool Option::setString(const std::string& data)
 
 const std::string& Option::toString() const
 {
-    return text;
+    countRead();
+    return getText();
 }
 
-std::string Option::toStringWithQuotes() const
+std::string Option::toStringWithQuotes(bool escape) const
 {
     // Automatically append quotes to the string if it originally had them
-    return (quotes ? ('"' + text + '"') : text);
+    if (!quotes)
+        return getText();
+    const std::string& text = getText();
+    std::string str;
+    str.reserve(text.size() + 2);
+    str += '"';
+    if (escape)
+        strlib::appendEscaped(text, str);
+    else
+        str += text;
+    str += '"';
+    return str;
 }
 
 int Option::toInt() const
 {
+    countRead();
     return integer;
 }
 
 long Option::toLong() const
 {
+    countRead();
     return static_cast<long>(integer);
 }
 
 float Option::toFloat() const
 {
+    countRead();
     return static_cast<float>(decimal);
 }
 
 double Option::toDouble() const
 {
+    countRead();
     return decimal;
 }
 
 bool Option::toBool() const
 {
+    countRead();
     return boolean;
 }
 
 char Option::toChar() const
 {
+    countRead();
     return static_cast<char>(integer);
 }
 
 void Option::get(std::string& val) const
 {
-    val = text;
+    countRead();
+    val = getText();
 }
 
 void Option::get(long& val) const
 {
+    countRead();
     val = integer;
 }
 
 void Option::get(double& val) const
 {
+    countRead();
     val = decimal;
 }
 
 void Option::get(bool& val) const
 {
+    countRead();
     val = boolean;
 }
 
 Option::operator const std::string&() const
 {
-    return text;
+    countRead();
+    return getText();
 }
 
 void Option::setQuotes(bool setting)
 {
+    if (quotes != setting)
+        touch();
     quotes = setting;
 }
 
-bool Option::hasQuotes()
+bool Option::hasQuotes() const
 {
     return quotes;
 }
@@ -186,40 +249,86 @@ void Option::removeRange()
 
 Option& Option::push(const Option& opt)
 {
+    unpack();
     if (!options)
         options = std::make_unique<OptionVector>();
+    size_t capacity = options->capacity();
     options->push_back(opt);
+    if (options->capacity() != capacity)
+        trackElements(); // The elements were copied to the new storage
+    else if (parentRevision)
+        options->back().setParentRevision(parentRevision);
+    touch();
     return options->back();
 }
 
 void Option::pop()
 {
-    if (options && !options->empty())
+    if (numbers && !numbers->decimals.empty())
+    {
+        numbers->decimals.pop_back();
+        numbers->integers.pop_back();
+        if (options)
+            options->pop_back();
+        touch();
+    }
+    else if (options && !options->empty())
+    {
         options->pop_back();
+        touch();
+    }
 }
 
 Option& Option::operator[](unsigned pos)
 {
+    countRead();
+    unpack();
     return ((*options)[pos]);
 }
 
 Option& Option::back()
 {
+    countRead();
+    unpack();
     return options->back();
 }
 
 unsigned Option::size() const
 {
+    if (numbers)
+        return numbers->decimals.size();
     return (options ? options->size() : 0);
 }
 
 void Option::clear()
 {
+    if (options || numbers)
+        touch();
     options.reset();
+    numbers.reset();
+}
+
+void Option::reserve(unsigned count)
+{
+    if (options && !numbers)
+    {
+        options->reserve(count);
+        trackElements();
+    }
+    else
+    {
+        // Arrays start out as numeric arrays, until something else is added
+        if (!numbers)
+            numbers = std::make_unique<NumericArray>();
+        numbers->decimals.reserve(count);
+        numbers->integers.reserve(count);
+    }
 }
 
 Option::OptionVector::iterator Option::begin()
 {
+    countRead();
+    unpack();
     if (options)
         return options->begin();
     return emptyVector.begin();
@@ -227,6 +336,7 @@ Option::OptionVector::iterator Option::begin()
 
 Option::OptionVector::iterator Option::end()
 {
+    unpack();
     if (options)
         return options->end();
     return emptyVector.end();
@@ -234,6 +344,8 @@ Option::OptionVector::iterator Option::end()
 
 Option::OptionVector::const_iterator Option::cbegin() const
 {
+    countRead();
+    buildElements();
     if (options)
         return options->cbegin();
     return emptyVector.cbegin();
@@ -241,13 +353,86 @@ Option::OptionVector::const_iterator Option::cbegin() const
 
 Option::OptionVector::const_iterator Option::cend() const
 {
+    buildElements();
     if (options)
         return options->cend();
     return emptyVector.cend();
 }
 
-std::string Option::buildArrayString(const std::string& indentStr) const
+bool Option::pack()
+{
+    if (numbers)
+        return true;
+    if (!options)
+        return false;
+    for (const auto& opt: *options)
+    {
+        // The text has to stay the same, so "1.50" or "007" keep the array as options
+        if (!opt.isPlainNumber() || !isCanonicalNumber(opt.getText(), opt.decimal, opt.integer))
+            return false;
+    }
+
+    // Every element is a number, so only the values need to be kept
+    auto packed = std::make_unique<NumericArray>();
+    packed->decimals.reserve(options->size());
+    packed->integers.reserve(options->size());
+    for (const auto& opt: *options)
+    {
+        packed->decimals.push_back(opt.decimal);
+        packed->integers.push_back(opt.integer);
+    }
+    numbers = std::move(packed);
+    options.reset();
+    touch();
+    return true;
+}
+
+bool Option::isNumericArray() const
 {
+    return (numbers != nullptr);
+}
+
+const std::vector<double>& Option::asDoubles() const
+{
+    countRead();
+    static const std::vector<double> emptyDoubles;
+    return (numbers ? numbers->decimals : emptyDoubles);
+}
+
+const std::vector<long>& Option::asLongs() const
+{
+    countRead();
+    static const std::vector<long> emptyLongs;
+    return (numbers ? numbers->integers : emptyLongs);
+}
+
+bool Option::isCanonicalNumber(std::string_view str, double decimalVal, long integerVal)
+{
+    // This runs for every element of an array being parsed, so the number is formatted on the stack
+    char buffer[64];
+    return (str == std::string_view(buffer, formatNumber(buffer, decimalVal, integerVal) - buffer));
+}
+
+std::string Option::buildArrayString(const std::string& indentStr, bool escape) const
+{
+    if (numbers)
+    {
+        // Numeric arrays are converted directly, without creating any options
+        std::string nextIndentStr(indentStr + '\t');
+        std::string arrayStr("{\n");
+        unsigned arraySize = numbers->decimals.size();
+        arrayStr.reserve(arraySize * (nextIndentStr.size() + 8));
+        for (unsigned i = 0; i < arraySize; ++i)
+        {
+            arrayStr += nextIndentStr;
+            appendNumber(arrayStr, numbers->decimals[i], numbers->integers[i]);
+            if (i < arraySize - 1)
+                arrayStr += ",\n";
+        }
+        arrayStr += '\n' + indentStr + '}';
+        return arrayStr;
+    }
+
     // Continue building array strings until the option is just a single element and not an array
     if (options)
     {
@@ -259,7 +444,7 @@ std::string Option::buildArrayString(const std::string& indentStr) const
         for (unsigned i = 0; i < arraySize; ++i)
         {
             arrayStr += nextIndentStr;
-            arrayStr += (*options)[i].buildArrayString(nextIndentStr);
+            arrayStr += (*options)[i].buildArrayString(nextIndentStr, escape);
             if (i < arraySize - 1)
                 arrayStr += ",\n";
         }
@@ -267,7 +452,221 @@ std::string Option::buildArrayString(const std::string& indentStr) const
         return arrayStr;
     }
     else
-        return toStringWithQuotes();
+        return toStringWithQuotes(escape);
+}
+
+std::uint64_t Option::getRevision() const
+{
+    // Array elements can be changed directly, so they need to be checked too
+    std::uint64_t latest = revision;
+    if (options && !numbers)
+    {
+        for (const auto& opt: *options)
+            latest = std::max(latest, opt.getRevision());
+    }
+    return latest;
+}
+
+MemoryUsage Option::memoryUsage() const
+{
+    MemoryUsage usage;
+    usage.options = sizeof(Option);
+    usage.text = MemoryUsage::getHeapSize(text);
+    if (options)
+    {
+        usage.arrays += sizeof(OptionVector) + (options->capacity() - options->size()) * sizeof(Option);
+        for (const auto& opt: *options)
+            usage += opt.memoryUsage();
+    }
+    if (numbers)
+    {
+        usage.arrays += sizeof(NumericArray) + numbers->decimals.capacity() * sizeof(double)
+            + numbers->integers.capacity() * sizeof(long);
+    }
+    return usage;
+}
+
+void Option::shrinkToFit()
+{
+    text.shrink_to_fit();
+    if (options)
+    {
+        options->shrink_to_fit();
+        for (auto& opt: *options)
+            opt.shrinkToFit();
+        trackElements();
+    }
+    if (numbers)
+    {
+        numbers->decimals.shrink_to_fit();
+        numbers->integers.shrink_to_fit();
+    }
+}
+
+void Option::intern(StringPool& pool)
+{
+    // Short strings are stored inside of the string object, so sharing them would not save anything
+    if (quotes && !sharedText && text.size() > std::string().capacity())
+    {
+        sharedText = pool.intern(text);
+        text = std::string();
+    }
+    if (options)
+    {
+        for (auto& opt: *options)
+            opt.intern(pool);
+    }
+}
+
+bool Option::isInterned() const
+{
+    return (sharedText != nullptr);
+}
+
+bool Option::sharesText(const Option& option) const
+{
+    return (sharedText && sharedText == option.sharedText);
+}
+
+void Option::setCounter(AccessCounter* newCounter)
+{
+    counter = newCounter;
+}
+
+AccessCounter* Option::getCounter() const
+{
+    return counter;
+}
+
+std::uint64_t Option::nextRevision()
+{
+    return ++revisionCounter;
+}
+
+std::uint64_t Option::getLatestRevision()
+{
+    return revisionCounter.load();
+}
+
+void Option::setParentRevision(std::uint64_t* newParentRevision) const
+{
+    parentRevision = newParentRevision;
+    if (options && !numbers)
+    {
+        for (auto& opt: *options)
+            opt.setParentRevision(parentRevision);
+    }
+}
+
+void Option::touch()
+{
+    revision = nextRevision();
+    if (parentRevision)
+        *parentRevision = revision;
+    if (counter)
+        counter->countWrite();
+}
+
+void Option::trackElements()
+{
+    if (parentRevision)
+        setParentRevision(parentRevision);
+}
+
+const std::string& Option::getText() const
+{
+    switch (pendingText)
+    {
+        case PendingText::None:
+            return (sharedText ? *sharedText : text);
+        case PendingText::Integer:
+            text = strlib::toString(integer);
+            break;
+        case PendingText::Unsigned:
+            text = strlib::toString(static_cast<unsigned long>(integer));
+            break;
+        case PendingText::Float:
+            text = strlib::toString(static_cast<float>(decimal));
+            break;
+        case PendingText::Double:
+            text = strlib::toString(decimal);
+            break;
+    }
+    pendingText = PendingText::None;
+    return text;
+}
+
+bool Option::isPlainNumber() const
+{
+    if (quotes || minEnabled || maxEnabled || options || numbers)
+        return false;
+    if (pendingText == PendingText::Float)
+        return false; // The text would not be the same as a double
+    if (pendingText != PendingText::None)
+        return true;
+    double value;
+    return strlib::fromChars(getText(), value);
+}
+
+void Option::addNumber(double decimalVal, long integerVal)
+{
+    if (options && !numbers)
+    {
+        // The array already has other types of elements
+        Option& opt = push();
+        opt = decimalVal;
+        opt.integer = integerVal;
+        opt.pendingText = (decimalVal == static_cast<double>(integerVal) ? PendingText::Integer : PendingText::Double);
+        return;
+    }
+    if (!numbers)
+        numbers = std::make_unique<NumericArray>();
+    numbers->decimals.push_back(decimalVal);
+    numbers->integers.push_back(integerVal);
+    options.reset(); // The read-only elements are out of date
+    touch();
+}
+
+void Option::unpack()
+{
+    // The elements become the Option objects, so they can be changed
+    if (!numbers)
+        return;
+    buildElements();
+    numbers.reset();
+    trackElements();
+}
+
+void Option::buildElements() const
+{
+    if (!numbers || options)
+        return;
+    auto unpacked = std::make_unique<OptionVector>(numbers->decimals.size());
+    for (unsigned i = 0; i < unpacked->size(); ++i)
+    {
+        Option& opt = (*unpacked)[i];
+        opt.decimal = numbers->decimals[i];
+        opt.integer = numbers->integers[i];
+        opt.boolean = (opt.decimal != 0);
+        opt.pendingText = (opt.decimal == static_cast<double>(opt.integer) ? PendingText::Integer : PendingText::Double);
+        opt.revision = revision; // Nothing changed, only how it is stored
+    }
+    options = std::move(unpacked);
+}
+
+void Option::appendNumber(std::string& str, double decimalVal, long integerVal)
+{
+    char buffer[64];
+    str.append(buffer, formatNumber(buffer, decimalVal, integerVal));
+}
+
+char* Option::formatNumber(char (&buffer)[64], double decimalVal, long integerVal)
+{
+    // Whole numbers use the integer, so large integers keep all of their digits
+    auto result = (decimalVal == static_cast<double>(integerVal) ?
+        std::to_chars(buffer, buffer + sizeof(buffer), integerVal) :
+        std::to_chars(buffer, buffer + sizeof(buffer), decimalVal));
+    return result.ptr;
 }
 
 bool Option::isInRange(double num)
@@ -282,4 +681,26 @@ std::ostream& operator<<(std::ostream& stream, const Option& option)
     return stream;
 }
 
+size_t MemoryUsage::total() const
+{
+    return keys + text + options + arrays + nodes + caches;
+}
+
+MemoryUsage& MemoryUsage::operator+=(const MemoryUsage& usage)
+{
+    keys += usage.keys;
+    text += usage.text;
+    options += usage.options;
+    arrays += usage.arrays;
+    nodes += usage.nodes;
+    caches += usage.caches;
+    return *this;
+}
+
+size_t MemoryUsage::getHeapSize(const std::string& str)
+{
+    // Short strings are stored inside of the string object
+    static const size_t localCapacity = std::string().capacity();
+    return (str.capacity() > localCapacity ? str.capacity() + 1 : 0);
+}
 }
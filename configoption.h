@@ -8,11 +8,31 @@
 #include <memory>
 #include <vector>
 #include <limits>
+#include <atomic>
+#include <cstdint>
 #include "strlib.h"
+#include "configembed.h"
+#include "configpool.h"
+#include "configtelemetry.h"
 
 namespace cfg
 {
 
+// Bytes used by options, split up by what they are used for
+// Heap memory is counted by capacity, without the overhead of the allocator itself
+struct MemoryUsage
+{
+    size_t keys{}; // Option/section names that did not fit in the string objects
+    size_t text{}; // Text of values that did not fit in the string objects (shared text is counted by its pool)
+    size_t options{}; // The Option objects (numbers, ranges, flags, and the string objects)
+    size_t arrays{}; // Storage of array elements (the elements are counted in the other fields)
+    size_t nodes{}; // Nodes of the maps, including the string objects of the names
+    size_t caches{}; // Serialized text and other data that can be rebuilt
+    size_t total() const; // Returns the sum of everything
+    MemoryUsage& operator+=(const MemoryUsage& usage);
+    static size_t getHeapSize(const std::string& str); // Returns the bytes a string allocated, if any
+};
+
 // This class can store a value of different types based on a string
 class Option
 {
@@ -22,6 +42,8 @@ class Option
         Option() {} // Default constructor
         Option(const std::string& data); // Initialize with a string value
         Option(const Option& data); // Copy constructor
+        Option(const EmbeddedValue& data); // Initialize with a value generated at build time (nothing is parsed)
+        ~Option();
 
         void reset(); // Sets all values to 0 and removes the range
 
@@ -35,7 +57,7 @@ class Option
 
         // Getting will simply return the precomputed values
         const std::string& toString() const;
-        std::string toStringWithQuotes() const;
+        std::string toStringWithQuotes(bool escape = false) const; // Can also replace special characters with escape codes
         int toInt() const;
         long toLong() const;
         float toFloat() const;
@@ -64,7 +86,7 @@ class Option
 
         // For determining if the option was originally read in as a string with quotes
         void setQuotes(bool setting);
-        bool hasQuotes();
+        bool hasQuotes() const;
 
         // For setting the valid range
         void setMin(double minimum);
@@ -79,6 +101,7 @@ class Option
         Option& back();
         unsigned size() const;
         void clear();
+        void reserve(unsigned count); // Reserves space for array elements
 
         // Iterators for the array
         OptionVector::iterator begin();
@@ -90,14 +113,84 @@ class Option
         template <typename Type>
         Option& operator<<(const Type& val);
 
+        // Numeric arrays
+        // Arrays where every element is a plain number (no quotes, ranges, or sub-arrays) are stored contiguously.
+        // Numbers are only stored this way if they would be written back as the same text ("1.50" is not).
+        // Changing the elements as Option objects (operator[], back, push, iterators) converts them back into Options,
+        // which invalidates the vectors from asDoubles/asLongs. Const iterators keep the numbers.
+        template <typename Type>
+        void pushNumber(Type val); // Adds a number, keeping the array contiguous when possible
+        bool pack(); // Stores the array contiguously if possible, returns true if it is (invalidates references to elements)
+        bool isNumericArray() const; // Returns true if the array is currently stored contiguously
+        const std::vector<double>& asDoubles() const; // Returns all of the elements (empty if not a numeric array)
+        const std::vector<long>& asLongs() const; // Same as above, but the elements are converted like toLong()
+        static bool isCanonicalNumber(std::string_view str, double decimalVal, long integerVal); // Returns true if a numeric array would write the number as this text
+
         // Converts the entire option array to a string
-        std::string buildArrayString(const std::string& indentStr = "") const;
+        std::string buildArrayString(const std::string& indentStr = "", bool escape = false) const;
+
+        // Change tracking
+        // Every change gets a new revision number, which is larger than all of the previous ones
+        std::uint64_t getRevision() const; // Returns the latest revision of this option and its array elements
+        static std::uint64_t nextRevision(); // Returns a new revision number
+        static std::uint64_t getLatestRevision(); // Returns the last revision number given out (by any option)
+        void setParentRevision(std::uint64_t* newParentRevision) const; // Also stores every new revision there (null stops), including from elements (zero when destroyed)
+
+        // Memory usage
+        MemoryUsage memoryUsage() const; // Returns the bytes used by this option and its array elements
+        void shrinkToFit(); // Frees unused capacity of the text and arrays
+
+        // Shared text
+        // Strings that are too long to fit in a string object can share one copy of their text from a pool.
+        // Setting the option gives it its own text again, and copies of the option share the same text.
+        void intern(StringPool& pool); // Shares the text of quoted strings (and array elements) with the pool
+        bool isInterned() const; // Returns true if the text is shared
+        bool sharesText(const Option& option) const; // Returns true if both options use the same shared text
+
+        // Telemetry (see File::enableTelemetry)
+        // Getting values and accessing array elements count as reads, and changes count as writes.
+        // Converting to text for saving (toStringWithQuotes and buildArrayString) is not counted.
+        void setCounter(AccessCounter* newCounter); // Starts counting with a counter (null stops), which is not copied with the option
+        AccessCounter* getCounter() const;
 
     private:
+        // The type of number that still needs to be converted to text
+        enum class PendingText
+        {
+            None,
+            Integer,
+            Unsigned,
+            Float,
+            Double
+        };
+
+        // Contiguous storage for numeric arrays
+        struct NumericArray
+        {
+            std::vector<double> decimals;
+            std::vector<long> integers;
+        };
+
         bool isInRange(double num);
+        void touch(); // Marks the option as changed
+        void trackElements(); // Gives the array elements the same parent revision (after they were copied)
+        void countRead() const; // Counts a read, if this option has a counter
+        bool isPlainNumber() const; // Returns true if this can be stored in a numeric array
+        void addNumber(double decimalVal, long integerVal); // Adds an element to the numeric array
+        void unpack(); // Converts a numeric array back into Option objects
+        void buildElements() const; // Creates read-only Option objects for the elements of a numeric array
+        static void appendNumber(std::string& str, double decimalVal, long integerVal); // Converts an element of a numeric array to text
+        static char* formatNumber(char (&buffer)[64], double decimalVal, long integerVal); // Same as above, but into a buffer (returns the end)
+        const std::string& getText() const; // Converts a number set from code to text when it is first needed
+        template <typename Type>
+        static PendingText getPendingType();
 
         // The "set" function will set all of these, no matter what the type is
-        std::string text;
+        // Numbers set from code only create the text when it is used, so reading the text of those
+        // from multiple threads at the same time is not safe until it has been read once
+        mutable std::string text;
+        StringPool::Handle sharedText; // Used instead of "text" when it is set
+        mutable PendingText pendingText{PendingText::None};
         long integer{};
         double decimal{};
         bool boolean{};
@@ -109,14 +202,24 @@ class Option
         double rangeMin{};
         double rangeMax{};
 
-        std::unique_ptr<OptionVector> options;
+        std::uint64_t revision{nextRevision()};
+        mutable std::uint64_t* parentRevision{}; // Set by the file to find changed sections quickly, not copied with the option
+        AccessCounter* counter{}; // Only set while the file has telemetry enabled (released when the option is destroyed)
+
+        mutable std::unique_ptr<OptionVector> options;
         // Wrapping the vector with a pointer to prevent recursive construction and incomplete type issues
         // Also, this is only created when push() is called for the first time
         // Also, this array is separate from the option itself, and nothing is kept in sync
             // This means that the first element can be different from the option.
 
+        std::unique_ptr<NumericArray> numbers;
+        // When this is set, it holds the elements, and "options" is only a read-only copy for const iterators
+        // Like the text, the first const iteration creates that copy, which is not thread safe
+
         static OptionVector emptyVector;
         // This is used for returning iterators when the array isn't allocated
+
+        static std::atomic<std::uint64_t> revisionCounter;
 };
 
 template <typename Type>
@@ -128,21 +231,48 @@ bool Option::operator=(Type data)
         integer = data;
         decimal = data;
         boolean = (data != 0);
-        text = strlib::toString<Type>(data);
+        pendingText = getPendingType<Type>();
+        if (pendingText == PendingText::None)
+            text = strlib::toString<Type>(data);
+        else
+            text.clear();
+        sharedText.reset();
         quotes = false;
+        touch();
         return true;
     }
     return false;
 }
 
+template <typename Type>
+Option::PendingText Option::getPendingType()
+{
+    if (!strlib::isFormattedNumber<Type>::value)
+        return PendingText::None;
+    if (std::is_same<Type, float>::value)
+        return PendingText::Float;
+    if (std::is_floating_point<Type>::value)
+        return PendingText::Double;
+    if (std::is_unsigned<Type>::value)
+        return PendingText::Unsigned;
+    return PendingText::Integer;
+}
+
 template <typename Type>
 Type Option::to() const
 {
+    countRead();
     if (std::numeric_limits<Type>::is_integer)
         return static_cast<Type>(integer);
     return static_cast<Type>(decimal);
 }
 
+inline void Option::countRead() const
+{
+    if (counter)
+        counter->countRead();
+}
+
 // Stream operator overload
 std::ostream& operator<<(std::ostream& stream, const Option& option);
 
@@ -177,10 +307,20 @@ Option makeOption(Type data, double minimum, double maximum)
 template <typename Type>
 Option& Option::operator<<(const Type& val)
 {
-    push() = val;
+    // Integers and doubles can be stored in numeric arrays (floats would not keep their text)
+    if constexpr (strlib::isFormattedNumber<Type>::value && !std::is_same<Type, float>::value)
+        pushNumber(val);
+    else
+        push() = val;
     return *this;
 }
 
+template <typename Type>
+void Option::pushNumber(Type val)
+{
+    addNumber(static_cast<double>(val), static_cast<long>(val));
+}
+
 template <typename Type>
 const Option& Option::get(Type& val) const
 {
@@ -0,0 +1,70 @@
+// Copyright (C) 2014-2016 Eric Hebert (ayebear)
+// This code is licensed under MIT, see LICENSE.txt for details.
+
+#include "configpool.h"
+#include "configoption.h"
+#include <algorithm>
+#include <iterator>
+
+namespace cfg
+{
+
+std::shared_ptr<StringPool> StringPool::getGlobal()
+{
+    static auto pool = std::make_shared<StringPool>();
+    return pool;
+}
+
+StringPool::Handle StringPool::intern(std::string_view str)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    auto found = strings.find(str);
+    if (found != strings.end())
+        return found->second;
+
+    // Purging when the size doubles keeps the cost constant for each string
+    if (strings.size() >= purgeSize)
+    {
+        removeUnused();
+        purgeSize = std::max<size_t>(1024, strings.size() * 2);
+    }
+    auto handle = std::make_shared<const std::string>(str);
+    strings.emplace(*handle, handle);
+    return handle;
+}
+
+size_t StringPool::purge()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return removeUnused();
+}
+
+size_t StringPool::removeUnused()
+{
+    // A string only held by the pool can only be handed out again by intern(), so its count can't change while this is locked
+    size_t oldSize = strings.size();
+    for (auto it = strings.begin(); it != strings.end(); )
+        it = (it->second.use_count() == 1 ? strings.erase(it) : std::next(it));
+    return oldSize - strings.size();
+}
+
+size_t StringPool::size() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return strings.size();
+}
+
+size_t StringPool::memoryUsage() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    size_t bytes = strings.bucket_count() * sizeof(void*);
+    for (const auto& str: strings)
+    {
+        // Each node holds the key and handle, and make_shared puts the string next to its control block
+        bytes += sizeof(void*) + sizeof(str) + sizeof(std::string) + 2 * sizeof(long);
+        bytes += MemoryUsage::getHeapSize(*str.second);
+    }
+    return bytes;
+}
+
+}
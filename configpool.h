@@ -0,0 +1,48 @@
+// Copyright (C) 2014-2016 Eric Hebert (ayebear)
+// This code is licensed under MIT, see LICENSE.txt for details.
+
+#ifndef CFG_POOL_H
+#define CFG_POOL_H
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+namespace cfg
+{
+
+/*
+Stores one copy of each string, so options with the same long string values can share it.
+Only the values of quoted strings that are too long to fit inside of a string object are shared,
+since short ones (like "true" or "enabled") would not save anything. Option and section names
+are not shared, since they are the keys of the public maps (File::Section and File::ConfigMap),
+so lookups still compare them as strings. Handles keep their string alive, even after the pool
+is destroyed. Strings that are only held by the pool are removed by purge(), which also happens
+automatically as the pool grows. A pool can be shared by many files, and is safe to use from
+multiple threads.
+*/
+class StringPool
+{
+    public:
+        using Handle = std::shared_ptr<const std::string>;
+
+        static std::shared_ptr<StringPool> getGlobal(); // Returns a pool shared by the whole process
+
+        Handle intern(std::string_view str); // Returns the shared copy of a string, adding it if needed
+        size_t purge(); // Removes strings that are no longer used, returns the number removed
+        size_t size() const; // Returns the number of strings in the pool
+        size_t memoryUsage() const; // Returns the bytes used by the strings and the table
+
+    private:
+        size_t removeUnused(); // Removes strings only held by the pool (the mutex must be locked)
+
+        mutable std::mutex mutex;
+        std::unordered_map<std::string_view, Handle> strings; // The keys point to the text of the handles
+        size_t purgeSize{1024}; // Unused strings are purged when the pool reaches this size
+};
+
+}
+
+#endif
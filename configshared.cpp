@@ -0,0 +1,361 @@
+// Copyright (C) 2014-2016 Eric Hebert (ayebear)
+// This code is licensed under MIT, see LICENSE.txt for details.
+
+#include "configshared.h"
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <new>
+#include <vector>
+#include "configfile.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+    #define CFG_HAVE_SHM
+#endif
+
+namespace cfg
+{
+
+namespace
+{
+
+const std::uint32_t imageMagic = 0x43464753; // "CFGS"
+const std::uint32_t imageVersion = 1;
+
+struct ImageHeader
+{
+    std::uint32_t magic;
+    std::uint32_t version;
+    std::uint64_t slotCapacity;
+    std::atomic<std::uint64_t> generation;
+    std::atomic<std::uint32_t> active; // Index of the slot readers should use
+};
+
+// Odd sequence numbers mean the slot is being written
+struct SlotHeader
+{
+    std::atomic<std::uint64_t> sequence;
+    std::uint64_t used;
+};
+
+// Sections point to their option tables, and options point to their values
+// All offsets are from the start of the slot's data
+struct Entry
+{
+    std::uint32_t nameOffset;
+    std::uint32_t nameSize;
+    std::uint32_t offset;
+    std::uint32_t size;
+};
+
+static_assert(std::atomic<std::uint64_t>::is_always_lock_free, "Shared memory needs lock-free atomics");
+
+const size_t headerSize = 64;
+const size_t slotHeaderSize = 64;
+static_assert(sizeof(ImageHeader) <= headerSize && sizeof(SlotHeader) <= slotHeaderSize, "Headers must fit before the data");
+
+size_t getSlotOffset(size_t slot, size_t capacity)
+{
+    return headerSize + slot * (slotHeaderSize + capacity);
+}
+
+size_t getMappedSize(size_t capacity)
+{
+    return getSlotOffset(2, capacity);
+}
+
+// Returns the text at an offset, or false if it is outside of the data (which can happen while it is being replaced)
+bool getText(const char* data, size_t used, std::uint32_t offset, std::uint32_t size, std::string_view& text)
+{
+    if (offset > used || size > used - offset)
+        return false;
+    text = std::string_view(data + offset, size);
+    return true;
+}
+
+// Binary search through a table of entries sorted by name
+const Entry* findEntry(const char* data, size_t used, std::uint32_t tableOffset, std::uint32_t count, std::string_view name)
+{
+    if (tableOffset > used || count > (used - tableOffset) / sizeof(Entry))
+        return nullptr;
+    const Entry* first = reinterpret_cast<const Entry*>(data + tableOffset);
+    const Entry* last = first + count;
+    while (first < last)
+    {
+        const Entry* middle = first + (last - first) / 2;
+        std::string_view entryName;
+        if (!getText(data, used, middle->nameOffset, middle->nameSize, entryName))
+            return nullptr;
+        int result = entryName.compare(name);
+        if (result == 0)
+            return middle;
+        if (result < 0)
+            first = middle + 1;
+        else
+            last = middle;
+    }
+    return nullptr;
+}
+
+void appendEntry(std::vector<char>& image, size_t pos, const Entry& entry)
+{
+    std::memcpy(image.data() + pos, &entry, sizeof(Entry));
+}
+
+// Lays out the options as a table of sections, then the tables of options, then all of the text
+void buildImage(const File::ConfigMap& options, bool escapes, std::vector<char>& image)
+{
+    AccessCounter::Pause pause; // Publishing is not a read by the program
+    size_t optionCount = 0;
+    for (const auto& section: options)
+        optionCount += section.second.size();
+
+    size_t tablesEnd = sizeof(Entry) * (1 + options.size() + optionCount);
+    image.assign(tablesEnd, 0);
+    Entry count{static_cast<std::uint32_t>(options.size()), 0, 0, 0};
+    appendEntry(image, 0, count);
+
+    auto addText = [&image](const std::string& str, std::uint32_t& offset, std::uint32_t& size)
+    {
+        offset = static_cast<std::uint32_t>(image.size());
+        size = static_cast<std::uint32_t>(str.size());
+        image.insert(image.end(), str.begin(), str.end());
+    };
+
+    size_t sectionPos = sizeof(Entry);
+    size_t optionPos = sectionPos + sizeof(Entry) * options.size();
+    for (const auto& section: options)
+    {
+        Entry sectionEntry{};
+        addText(section.first, sectionEntry.nameOffset, sectionEntry.nameSize);
+        sectionEntry.offset = static_cast<std::uint32_t>(optionPos);
+        sectionEntry.size = static_cast<std::uint32_t>(section.second.size());
+        appendEntry(image, sectionPos, sectionEntry);
+        sectionPos += sizeof(Entry);
+        for (const auto& option: section.second)
+        {
+            Entry optionEntry{};
+            addText(option.first, optionEntry.nameOffset, optionEntry.nameSize);
+            if (option.second.size() > 0)
+                addText(option.second.buildArrayString("", escapes), optionEntry.offset, optionEntry.size);
+            else
+                addText(option.second.toString(), optionEntry.offset, optionEntry.size);
+            appendEntry(image, optionPos, optionEntry);
+            optionPos += sizeof(Entry);
+        }
+    }
+}
+
+}
+
+SharedPublisher::SharedPublisher(const std::string& name, size_t capacity):
+    name(name)
+{
+#ifdef CFG_HAVE_SHM
+    capacity = (capacity + 63) / 64 * 64;
+    int fd = shm_open(name.c_str(), O_CREAT | O_RDWR, 0644);
+    if (fd < 0)
+        return;
+    mappedSize = getMappedSize(capacity);
+    void* address = MAP_FAILED;
+    if (ftruncate(fd, mappedSize) == 0)
+        address = mmap(nullptr, mappedSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (address == MAP_FAILED)
+    {
+        mappedSize = 0;
+        return;
+    }
+    base = static_cast<char*>(address);
+
+    // The header is written last, so readers do not use the segment until it is ready
+    auto header = new (base) ImageHeader();
+    header->slotCapacity = capacity;
+    header->version = imageVersion;
+    for (size_t slot = 0; slot < 2; ++slot)
+        new (base + getSlotOffset(slot, capacity)) SlotHeader();
+    std::atomic_thread_fence(std::memory_order_release);
+    header->magic = imageMagic;
+#else
+    (void)capacity;
+#endif
+}
+
+SharedPublisher::~SharedPublisher()
+{
+#ifdef CFG_HAVE_SHM
+    if (base)
+        munmap(base, mappedSize);
+#endif
+}
+
+bool SharedPublisher::publish(const File& file)
+{
+    if (!base)
+        return false;
+    std::vector<char> image;
+    buildImage(file.options, (file.flags & File::Escapes) != 0, image);
+    auto header = reinterpret_cast<ImageHeader*>(base);
+    if (image.size() > header->slotCapacity)
+        return false;
+
+    // Write to the slot readers are not using, then switch them over to it
+    std::uint32_t slot = 1 - header->active.load(std::memory_order_relaxed);
+    char* slotBase = base + getSlotOffset(slot, header->slotCapacity);
+    auto slotHeader = reinterpret_cast<SlotHeader*>(slotBase);
+    auto sequence = slotHeader->sequence.load(std::memory_order_relaxed);
+    slotHeader->sequence.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    slotHeader->used = image.size();
+    std::memcpy(slotBase + slotHeaderSize, image.data(), image.size());
+    slotHeader->sequence.store(sequence + 2, std::memory_order_release);
+    header->active.store(slot, std::memory_order_release);
+    header->generation.fetch_add(1, std::memory_order_release);
+    return true;
+}
+
+bool SharedPublisher::isOpen() const
+{
+    return (base != nullptr);
+}
+
+void SharedPublisher::unlink()
+{
+#ifdef CFG_HAVE_SHM
+    shm_unlink(name.c_str());
+#endif
+}
+
+SharedConfig::SharedConfig()
+{
+}
+
+SharedConfig::SharedConfig(const std::string& name)
+{
+    open(name);
+}
+
+SharedConfig::~SharedConfig()
+{
+    close();
+}
+
+bool SharedConfig::open(const std::string& name)
+{
+    close();
+#ifdef CFG_HAVE_SHM
+    int fd = shm_open(name.c_str(), O_RDONLY, 0);
+    if (fd < 0)
+        return false;
+    struct stat info;
+    void* address = MAP_FAILED;
+    if (fstat(fd, &info) == 0 && static_cast<size_t>(info.st_size) > headerSize)
+        address = mmap(nullptr, info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (address == MAP_FAILED)
+        return false;
+    base = static_cast<const char*>(address);
+    mappedSize = info.st_size;
+
+    // Make sure this is a finished image of the same version
+    auto header = reinterpret_cast<const ImageHeader*>(base);
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (header->magic != imageMagic || header->version != imageVersion || getMappedSize(header->slotCapacity) > mappedSize)
+        close();
+#else
+    (void)name;
+#endif
+    return isOpen();
+}
+
+void SharedConfig::close()
+{
+#ifdef CFG_HAVE_SHM
+    if (base)
+        munmap(const_cast<char*>(base), mappedSize);
+#endif
+    base = nullptr;
+    mappedSize = 0;
+}
+
+bool SharedConfig::isOpen() const
+{
+    return (base != nullptr);
+}
+
+bool SharedConfig::read(std::string_view name, std::string_view section, std::string& value) const
+{
+    return find(name, section, &value, false);
+}
+
+std::string SharedConfig::get(std::string_view name, std::string_view section, const std::string& defaultValue) const
+{
+    std::string value;
+    if (!read(name, section, value))
+        value = defaultValue;
+    return value;
+}
+
+bool SharedConfig::optionExists(std::string_view name, std::string_view section) const
+{
+    return find(name, section, nullptr, false);
+}
+
+bool SharedConfig::sectionExists(std::string_view section) const
+{
+    return find("", section, nullptr, true);
+}
+
+std::uint64_t SharedConfig::getGeneration() const
+{
+    if (!base)
+        return 0;
+    return reinterpret_cast<const ImageHeader*>(base)->generation.load(std::memory_order_acquire);
+}
+
+bool SharedConfig::find(std::string_view name, std::string_view section, std::string* value, bool sectionOnly) const
+{
+    if (!base)
+        return false;
+    auto header = reinterpret_cast<const ImageHeader*>(base);
+    while (true)
+    {
+        // Find a slot that is not being written
+        std::uint32_t slot = header->active.load(std::memory_order_acquire);
+        const char* slotBase = base + getSlotOffset(slot, header->slotCapacity);
+        auto slotHeader = reinterpret_cast<const SlotHeader*>(slotBase);
+        auto sequence = slotHeader->sequence.load(std::memory_order_acquire);
+        if (sequence % 2 != 0)
+            continue;
+        if (sequence == 0)
+            return false; // Nothing was published yet
+
+        // Everything read here is only trusted if the slot did not change
+        const char* data = slotBase + slotHeaderSize;
+        size_t used = std::min<size_t>(slotHeader->used, header->slotCapacity);
+        bool found = false;
+        std::string_view text;
+        const Entry* sectionEntry = nullptr;
+        if (used >= sizeof(Entry))
+            sectionEntry = findEntry(data, used, sizeof(Entry), reinterpret_cast<const Entry*>(data)->nameOffset, section);
+        if (sectionEntry && sectionOnly)
+            found = true;
+        else if (sectionEntry)
+        {
+            const Entry* optionEntry = findEntry(data, used, sectionEntry->offset, sectionEntry->size, name);
+            found = (optionEntry && getText(data, used, optionEntry->offset, optionEntry->size, text));
+            if (found && value)
+                value->assign(text.data(), text.size());
+        }
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (slotHeader->sequence.load(std::memory_order_relaxed) == sequence)
+            return found;
+    }
+}
+
+}
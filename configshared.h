@@ -0,0 +1,75 @@
+// Copyright (C) 2014-2016 Eric Hebert (ayebear)
+// This code is licensed under MIT, see LICENSE.txt for details.
+
+#ifndef CFG_SHARED_H
+#define CFG_SHARED_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+namespace cfg
+{
+
+class File;
+
+/*
+Publishes the options of a file into POSIX shared memory, so many processes can read them without parsing.
+The image only uses offsets, so it can be mapped at any address. It has two slots, and each publish
+writes to the slot that is not being used, so readers never wait (they retry if a slot changes under them).
+There should only be one publisher for each name. Only supported on POSIX systems.
+*/
+class SharedPublisher
+{
+    public:
+        SharedPublisher(const std::string& name, size_t capacity); // Creates the segment, "capacity" is the size of each slot in bytes
+        ~SharedPublisher();
+        SharedPublisher(const SharedPublisher&) = delete;
+        SharedPublisher& operator=(const SharedPublisher&) = delete;
+
+        bool publish(const File& file); // Publishes the options, returns false if they do not fit
+        bool isOpen() const; // Returns true if the segment was created
+        void unlink(); // Removes the segment name, existing readers keep their mapping
+
+    private:
+        std::string name;
+        size_t mappedSize{};
+        char* base{};
+};
+
+/*
+Reads options from an image made by SharedPublisher.
+Values are copied out, since the image can be replaced at any time.
+Arrays are returned in the same format as they are written to files.
+*/
+class SharedConfig
+{
+    public:
+        SharedConfig();
+        SharedConfig(const std::string& name);
+        ~SharedConfig();
+        SharedConfig(const SharedConfig&) = delete;
+        SharedConfig& operator=(const SharedConfig&) = delete;
+
+        bool open(const std::string& name); // Maps a published segment, returns true if it was successful
+        void close(); // Unmaps the segment
+        bool isOpen() const; // Returns true if a segment is mapped
+
+        bool read(std::string_view name, std::string_view section, std::string& value) const; // Copies the value of an option, returns false if it does not exist
+        std::string get(std::string_view name, std::string_view section, const std::string& defaultValue = "") const; // Returns the value of an option, or the default value
+        bool optionExists(std::string_view name, std::string_view section) const; // Returns true if an option exists
+        bool sectionExists(std::string_view section) const; // Returns true if a section exists
+        std::uint64_t getGeneration() const; // Returns the number of times the options were published
+
+    private:
+        // Looks up an option in one consistent version of the image, "value" can be null
+        bool find(std::string_view name, std::string_view section, std::string* value, bool sectionOnly) const;
+
+        size_t mappedSize{};
+        const char* base{};
+};
+
+}
+
+#endif
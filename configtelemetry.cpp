@@ -0,0 +1,152 @@
+// Copyright (C) 2014-2016 Eric Hebert (ayebear)
+// This code is licensed under MIT, see LICENSE.txt for details.
+
+#include "configtelemetry.h"
+#include <algorithm>
+#include "configoption.h"
+
+namespace cfg
+{
+
+thread_local unsigned AccessCounter::pauseCount{0};
+
+AccessCounter::AccessCounter(unsigned sampleInterval, Telemetry& telemetry):
+    samplesLeft(std::max(sampleInterval, 1u)),
+    sampleInterval(std::max(sampleInterval, 1u)),
+    telemetry(telemetry)
+{
+}
+
+std::uint64_t AccessCounter::getReads() const
+{
+    return reads.load(std::memory_order_relaxed);
+}
+
+std::uint64_t AccessCounter::getWrites() const
+{
+    return writes.load(std::memory_order_relaxed);
+}
+
+bool AccessCounter::wasRead() const
+{
+    return read.load(std::memory_order_relaxed);
+}
+
+void AccessCounter::reset()
+{
+    reads.store(0, std::memory_order_relaxed);
+    writes.store(0, std::memory_order_relaxed);
+    read.store(false, std::memory_order_relaxed);
+    samplesLeft.store(sampleInterval, std::memory_order_relaxed);
+}
+
+void AccessCounter::release()
+{
+    telemetry.release(*this);
+}
+
+AccessCounter::Pause::Pause()
+{
+    ++pauseCount;
+}
+
+AccessCounter::Pause::~Pause()
+{
+    --pauseCount;
+}
+
+std::vector<TelemetryReport::OptionStats> TelemetryReport::getUnread() const
+{
+    std::vector<OptionStats> unread;
+    for (const auto& option: options)
+    {
+        if (!option.wasRead)
+            unread.push_back(option);
+    }
+    return unread;
+}
+
+std::vector<TelemetryReport::OptionStats> TelemetryReport::getHottest(size_t count) const
+{
+    std::vector<OptionStats> hottest(options);
+    count = std::min(count, hottest.size());
+    std::partial_sort(hottest.begin(), hottest.begin() + count, hottest.end(),
+        [](const OptionStats& a, const OptionStats& b){ return a.reads > b.reads; });
+    hottest.resize(count);
+    return hottest;
+}
+
+std::string TelemetryReport::toString() const
+{
+    std::string str;
+    for (const auto& option: options)
+    {
+        str += '[' + option.section + "] " + option.name;
+        str += " reads=" + std::to_string(option.reads) + " writes=" + std::to_string(option.writes);
+        if (!option.wasRead)
+            str += " unread";
+        str += '\n';
+    }
+    return str;
+}
+
+Telemetry::Telemetry()
+{
+}
+
+Telemetry::Telemetry(const Telemetry&)
+{
+}
+
+Telemetry& Telemetry::operator=(const Telemetry&)
+{
+    // The assigned options are copies without counters, so this file keeps its own counters and settings
+    // The options they replace give their counters back when they are destroyed, and the copies get counters when they are attached
+    return *this;
+}
+
+void Telemetry::enable(unsigned newSampleInterval)
+{
+    sampleInterval = newSampleInterval;
+    enabled = true;
+}
+
+void Telemetry::disable()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    freeCounters.clear();
+    counters.clear();
+    enabled = false;
+}
+
+bool Telemetry::isEnabled() const
+{
+    return enabled;
+}
+
+void Telemetry::attach(Option& option)
+{
+    if (enabled && !option.getCounter())
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (freeCounters.empty())
+        {
+            counters.emplace_back(sampleInterval, *this);
+            option.setCounter(&counters.back());
+        }
+        else
+        {
+            freeCounters.back()->reset();
+            option.setCounter(freeCounters.back());
+            freeCounters.pop_back();
+        }
+    }
+}
+
+void Telemetry::release(AccessCounter& counter)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    freeCounters.push_back(&counter);
+}
+
+}
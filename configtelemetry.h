@@ -0,0 +1,139 @@
+// Copyright (C) 2014-2016 Eric Hebert (ayebear)
+// This code is licensed under MIT, see LICENSE.txt for details.
+
+#ifndef CFG_TELEMETRY_H
+#define CFG_TELEMETRY_H
+
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace cfg
+{
+
+class Option;
+class Telemetry;
+
+/*
+Counts how often an option is read and written, see File::enableTelemetry().
+Counters are only touched with relaxed atomics. With a sample interval, each counter only adds
+to its read count every "sampleInterval" reads, so the counts are estimates (reads on different
+threads at the same time can also be missed), but an option that was read at all is always marked as read.
+*/
+class AccessCounter
+{
+    public:
+        AccessCounter(unsigned sampleInterval, Telemetry& telemetry);
+
+        void countRead();
+        void countWrite();
+        std::uint64_t getReads() const;
+        std::uint64_t getWrites() const;
+        bool wasRead() const;
+        void reset(); // Clears the counts, so the counter can be given to another option
+        void release(); // Gives the counter back to its telemetry, when its option is destroyed
+
+        // Reads are not counted on the current thread while this exists, for code that reads every option (like publishing)
+        class Pause
+        {
+            public:
+                Pause();
+                ~Pause();
+                Pause(const Pause&) = delete;
+                Pause& operator=(const Pause&) = delete;
+        };
+
+    private:
+        std::atomic<std::uint64_t> reads{};
+        std::atomic<std::uint64_t> writes{};
+        std::atomic<bool> read{};
+        std::atomic<unsigned> samplesLeft; // Reads until the next sample is added
+        unsigned sampleInterval;
+        Telemetry& telemetry; // Where the counter goes when it is released
+
+        static thread_local unsigned pauseCount;
+};
+
+// The counts of all of the options in a file, from File::getTelemetryReport()
+struct TelemetryReport
+{
+    struct OptionStats
+    {
+        std::string section;
+        std::string name;
+        std::uint64_t reads{};
+        std::uint64_t writes{}; // Includes loading again after telemetry was enabled
+        bool wasRead{};
+    };
+
+    struct SectionStats
+    {
+        std::string section;
+        std::uint64_t reads{}; // Sums of the options
+        std::uint64_t writes{};
+        size_t unreadOptions{};
+    };
+
+    std::vector<OptionStats> options; // Sorted by section, then name
+    std::vector<SectionStats> sections;
+
+    std::vector<OptionStats> getUnread() const; // Returns the options that were never read
+    std::vector<OptionStats> getHottest(size_t count) const; // Returns the options that were read the most
+    std::string toString() const; // Returns a line for each option, like "[section] name reads=10 writes=1"
+};
+
+// The counters of a file, which gives each option a counter with a stable address
+// Counters of options that are destroyed are reused, so erasing and loading options again doesn't add more
+// Attaching and releasing counters is locked, since options in different sections can be added and erased at the same time
+// Copies start disabled, since the counters belong to the options of one file
+class Telemetry
+{
+    public:
+        Telemetry();
+        Telemetry(const Telemetry&);
+        Telemetry& operator=(const Telemetry&);
+
+        void enable(unsigned sampleInterval);
+        void disable(); // The options must be detached first
+        bool isEnabled() const;
+        void attach(Option& option); // Gives an option a counter, if it doesn't have one yet
+        void release(AccessCounter& counter); // Keeps a counter for the next option, after its option was destroyed
+
+    private:
+        std::mutex mutex; // Protects the counters and the free list
+        std::deque<AccessCounter> counters;
+        std::vector<AccessCounter*> freeCounters; // Released counters, which are given to new options first
+        unsigned sampleInterval{1};
+        bool enabled{};
+};
+
+inline void AccessCounter::countRead()
+{
+    if (pauseCount > 0)
+        return;
+
+    // Loading first means the cache line is only written once, even when many threads read the option
+    if (!read.load(std::memory_order_relaxed))
+        read.store(true, std::memory_order_relaxed);
+    // The countdown is not a read-modify-write, so reads at the same time can be missed instead of contending
+    unsigned left = samplesLeft.load(std::memory_order_relaxed);
+    if (left > 1)
+        samplesLeft.store(left - 1, std::memory_order_relaxed);
+    else
+    {
+        samplesLeft.store(sampleInterval, std::memory_order_relaxed);
+        reads.fetch_add(sampleInterval, std::memory_order_relaxed);
+    }
+}
+
+inline void AccessCounter::countWrite()
+{
+    writes.fetch_add(1, std::memory_order_relaxed);
+}
+
+}
+
+#endif
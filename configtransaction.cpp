@@ -0,0 +1,229 @@
+// Copyright (C) 2014-2016 Eric Hebert (ayebear)
+// This code is licensed under MIT, see LICENSE.txt for details.
+
+#include "configtransaction.h"
+
+namespace cfg
+{
+
+File::Transaction::Staged::Staged(Transaction& transaction, Option& option):
+    transaction(transaction),
+    option(option)
+{
+}
+
+Option& File::Transaction::Staged::get()
+{
+    return option;
+}
+
+Option* File::Transaction::Staged::operator->()
+{
+    return &option;
+}
+
+File::Transaction::Staged::operator const Option&() const
+{
+    return option;
+}
+
+File::Transaction::Transaction(File& file):
+    file(file)
+{
+}
+
+File::Transaction::Staged File::Transaction::operator()(const std::string& name, const std::string& section)
+{
+    return Staged(*this, stage(name, section));
+}
+
+Option& File::Transaction::stage(const std::string& name, const std::string& section)
+{
+    StagedSection& stagedSection = staged[section];
+    auto inserted = stagedSection.options.try_emplace(name);
+    auto& option = inserted.first->second;
+    if (inserted.second)
+    {
+        // Start with the current value, so ranges and array elements are kept
+        ++changes;
+        const Section* current = (stagedSection.erased ? nullptr : file.findSection(section));
+        if (current)
+        {
+            auto optionFound = current->find(name);
+            if (optionFound != current->end())
+                option = std::make_unique<Option>(optionFound->second);
+        }
+    }
+    if (!option)
+        option = std::make_unique<Option>(); // New, or erased earlier in the transaction
+    return *option;
+}
+
+void File::Transaction::eraseOption(const std::string& name, const std::string& section)
+{
+    auto inserted = staged[section].options.try_emplace(name);
+    if (inserted.second)
+        ++changes;
+    inserted.first->second.reset();
+}
+
+void File::Transaction::eraseSection(const std::string& section)
+{
+    StagedSection& stagedSection = staged[section];
+    changes -= stagedSection.options.size();
+    stagedSection.options.clear();
+    if (!stagedSection.erased)
+        ++changes;
+    stagedSection.erased = true;
+}
+
+const Option* File::Transaction::find(const std::string& name, const std::string& section) const
+{
+    auto sectionFound = staged.find(section);
+    if (sectionFound != staged.end())
+    {
+        auto optionFound = sectionFound->second.options.find(name);
+        if (optionFound != sectionFound->second.options.end())
+            return optionFound->second.get();
+        if (sectionFound->second.erased)
+            return nullptr;
+    }
+    const Section* current = file.findSection(section);
+    if (current)
+    {
+        auto optionFound = current->find(name);
+        if (optionFound != current->end())
+            return &optionFound->second;
+    }
+    return nullptr;
+}
+
+bool File::Transaction::optionExists(const std::string& name, const std::string& section) const
+{
+    return (find(name, section) != nullptr);
+}
+
+bool File::Transaction::commit()
+{
+    if (!valid)
+    {
+        rollback();
+        return false;
+    }
+
+    // Everything that needs memory is created before the file is changed
+    struct Prepared
+    {
+        Section values; // Copies of the staged options, which get moved into the file
+        ConfigMap::node_type newSection; // Only set if the section needs to be added
+        SectionNode* node{};
+    };
+    std::vector<Prepared> prepared(staged.size());
+    auto preparedSection = prepared.begin();
+    for (auto& stagedSection: staged)
+    {
+        for (auto& option: stagedSection.second.options)
+        {
+            if (option.second)
+                preparedSection->values.emplace(option.first, *option.second);
+        }
+        bool exists = (!stagedSection.second.erased && file.options.count(stagedSection.first) > 0);
+        if (!exists && !preparedSection->values.empty())
+        {
+            ConfigMap newSection;
+            newSection.emplace(stagedSection.first, Section());
+            preparedSection->newSection = newSection.extract(newSection.begin());
+            preparedSection->node = &file.sectionTree.getNode(stagedSection.first);
+        }
+        ++preparedSection;
+    }
+    std::vector<Applied> applied;
+    applied.reserve(changes);
+    std::vector<ConfigMap::node_type> erasedSections;
+    erasedSections.reserve(staged.size());
+
+    // Only map nodes are moved from here on, so nothing can fail halfway
+    preparedSection = prepared.begin();
+    for (auto& stagedSection: staged)
+    {
+        const std::string& sectionName = stagedSection.first;
+        auto sectionFound = file.options.find(sectionName);
+        if (stagedSection.second.erased && sectionFound != file.options.end())
+        {
+            file.sectionTree.unlink(sectionName);
+            erasedSections.push_back(file.options.extract(sectionFound));
+            sectionFound = file.options.end();
+        }
+        if (preparedSection->newSection)
+        {
+            sectionFound = file.options.insert(std::move(preparedSection->newSection)).position;
+            file.sectionTree.link(*preparedSection->node, &sectionFound->second);
+        }
+        for (auto& option: stagedSection.second.options)
+        {
+            Applied change{option.first, sectionName, {}, nullptr};
+            if (sectionFound != file.options.end())
+            {
+                Section& section = sectionFound->second;
+                change.oldOption = section.extract(option.first);
+                if (option.second)
+                    change.newOption = &section.insert(preparedSection->values.extract(option.first)).position->second;
+            }
+            applied.push_back(std::move(change));
+        }
+        ++preparedSection;
+    }
+
+    notify(applied, erasedSections);
+    rollback();
+    return true;
+}
+
+void File::Transaction::notify(std::vector<Applied>& applied, std::vector<ConfigMap::node_type>& erasedSections)
+{
+    bool interpolate = (file.flags & Interpolate);
+    if (interpolate)
+    {
+        for (auto& erasedSection: erasedSections)
+        {
+            for (const auto& option: erasedSection.mapped())
+                file.interpolation.erase(option.first, erasedSection.key());
+        }
+    }
+    const Option noOption;
+    for (auto& change: applied)
+    {
+        if (change.newOption)
+        {
+            Option& option = *change.newOption;
+            file.telemetry.attach(option);
+            if (file.isWatched(change.name, change.section))
+                file.callWatchers(change.name, change.section, (change.oldOption ? change.oldOption.mapped() : noOption), option);
+            if (interpolate)
+                file.updateInterpolation(change.name, change.section, option);
+        }
+        else if (change.oldOption && interpolate)
+            file.interpolation.erase(change.name, change.section);
+    }
+    file.resolveInterpolation();
+    file.notifyChange();
+}
+
+void File::Transaction::rollback()
+{
+    staged.clear();
+    changes = 0;
+    valid = true;
+}
+
+bool File::Transaction::isValid() const
+{
+    return valid;
+}
+
+size_t File::Transaction::size() const
+{
+    return changes;
+}
+
+}
@@ -0,0 +1,112 @@
+// Copyright (C) 2014-2016 Eric Hebert (ayebear)
+// This code is licensed under MIT, see LICENSE.txt for details.
+
+#ifndef CFG_TRANSACTION_H
+#define CFG_TRANSACTION_H
+
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+#include "configfile.h"
+
+namespace cfg
+{
+
+/*
+Stages changes to a file, so they can all be applied at once, or thrown away.
+The file is not touched until commit() is called, so it can still be read while changes are staged.
+There is no versioning, so commit() changes the maps of the file in place: nothing else may read
+or change the file (from any thread) until it returns.
+Only the changed options are copied, so rolling back only costs as much as the changes.
+Committing copies the staged options first, and then moves them into the file without allocating,
+so the file either gets every change or none of them (if copying runs out of memory).
+The change callbacks of the file (see File::onChange) are called after every change is in the file.
+*/
+class File::Transaction
+{
+    public:
+        // A staged option, where assigning a value is checked like set()
+        class Staged
+        {
+            public:
+                template <typename Type>
+                bool operator=(const Type& value); // Stages a new value, the commit fails if it is out of range
+                Option& get(); // Returns the staged copy, changes made to it directly are not checked
+                Option* operator->();
+                operator const Option&() const;
+
+            private:
+                friend class Transaction;
+                Staged(Transaction& transaction, Option& option);
+
+                Transaction& transaction;
+                Option& option;
+        };
+
+        Transaction(File& file);
+
+        // Staging changes
+        Staged operator()(const std::string& name, const std::string& section); // Returns a staged copy of an option (or a new option)
+        template <typename Type>
+        bool set(const std::string& name, const std::string& section, const Type& value); // Stages a new value, the commit fails if it is out of range
+        void eraseOption(const std::string& name, const std::string& section); // Stages erasing an option
+        void eraseSection(const std::string& section); // Stages erasing a section (and anything staged in it before)
+
+        // Reading through the staged changes
+        const Option* find(const std::string& name, const std::string& section) const; // Returns the staged or current option, or null if it does not exist
+        bool optionExists(const std::string& name, const std::string& section) const; // Returns true if the option will exist after the commit
+
+        // Finishing
+        bool commit(); // Applies all of the staged changes, returns false (and applies nothing) if a value was out of range (needs exclusive access to the file)
+        void rollback(); // Throws away all of the staged changes
+        bool isValid() const; // Returns false if a value was out of range
+        size_t size() const; // Returns the number of staged changes
+
+    private:
+        // Erased options are stored as null pointers
+        struct StagedSection
+        {
+            bool erased{}; // Erase the section before applying the options
+            std::map<std::string, std::unique_ptr<Option>> options;
+        };
+
+        // A change that was moved into the file, with the option it replaced
+        struct Applied
+        {
+            const std::string& name;
+            const std::string& section;
+            Section::node_type oldOption;
+            Option* newOption; // Null if the option was erased
+        };
+
+        Option& stage(const std::string& name, const std::string& section); // Returns a staged copy of an option
+        void notify(std::vector<Applied>& applied, std::vector<ConfigMap::node_type>& erasedSections); // Updates the file after the changes are in
+
+        File& file;
+        std::map<std::string, StagedSection> staged;
+        size_t changes{};
+        bool valid{true};
+};
+
+template <typename Type>
+bool File::Transaction::set(const std::string& name, const std::string& section, const Type& value)
+{
+    bool status = (stage(name, section) = value);
+    if (!status)
+        valid = false;
+    return status;
+}
+
+template <typename Type>
+bool File::Transaction::Staged::operator=(const Type& value)
+{
+    bool status = (option = value);
+    if (!status)
+        transaction.valid = false;
+    return status;
+}
+
+}
+
+#endif
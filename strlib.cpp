@@ -11,10 +11,12 @@ namespace strlib
 
 void trimWhitespace(std::string& str)
 {
-    while (!str.empty() && std::isspace(str.back())) // Loop until right side contains no whitespace
+    while (!str.empty() && std::isspace(static_cast<unsigned char>(str.back()))) // Loop until right side contains no whitespace
         str.pop_back(); // Remove last character
-    while (!str.empty() && std::isspace(str.front())) // Loop until left side contains no whitespace
-        str.erase(str.begin()); // Remove first character
+    size_t first = 0;
+    while (first < str.size() && std::isspace(static_cast<unsigned char>(str[first]))) // Find where the left side's whitespace ends
+        ++first;
+    str.erase(0, first); // Remove it all at once, so this stays linear
 }
 
 void stripNewLines(std::string& str)
@@ -93,38 +95,329 @@ std::vector<std::string> split(const std::string& str, const std::string& delim)
     return elements;
 }
 
-std::vector<std::string> getLinesFromString(const std::string& str)
+SplitRange::iterator::iterator(std::string_view str, std::string_view delim, size_t start):
+    str(str),
+    delim(delim),
+    start(start)
 {
-    std::string tmpStr(str);
+    findPiece();
+}
+
+SplitRange::iterator& SplitRange::iterator::operator++()
+{
+    start = next;
+    findPiece();
+    return *this;
+}
+
+SplitRange::iterator SplitRange::iterator::operator++(int)
+{
+    iterator tmp(*this);
+    ++*this;
+    return tmp;
+}
+
+void SplitRange::iterator::findPiece()
+{
+    // Like split(), the part after the last delimiter is only used if it is not empty
+    if (start == std::string_view::npos || start >= str.size())
+    {
+        start = std::string_view::npos;
+        return;
+    }
+    size_t end = (delim.empty() ? std::string_view::npos : str.find(delim, start));
+    if (end == std::string_view::npos)
+    {
+        piece = str.substr(start);
+        next = str.size();
+    }
+    else
+    {
+        piece = str.substr(start, end - start);
+        next = end + delim.size();
+    }
+}
 
-    // First, search and replace all CRLF with LF
-    // This needs to be a while loop in case there is something like "\r\r\n"
-    while (replaceAll(tmpStr, "\r\n", "\n"));
+SplitRange::SplitRange(std::string_view str, std::string_view delim):
+    str(str),
+    delim(delim)
+{
+}
 
-    // Then, replace CR with LF
-    replaceAll(tmpStr, "\r", "\n");
+SplitRange::iterator SplitRange::begin() const
+{
+    return iterator(str, delim, 0);
+}
 
-    // Finally, split on LF
-    return split(tmpStr, "\n");
+SplitRange::iterator SplitRange::end() const
+{
+    return iterator();
 }
 
-bool readLinesFromFile(const std::string& filename, std::vector<std::string>& lines)
+SplitRange splitView(std::string_view str, std::string_view delim)
+{
+    return SplitRange(str, delim);
+}
+
+bool iequals(std::string_view str1, std::string_view str2)
+{
+    if (str1.size() != str2.size())
+        return false;
+    for (size_t i = 0; i < str1.size(); ++i)
+    {
+        char c1 = str1[i];
+        char c2 = str2[i];
+        if (c1 != c2)
+        {
+            // Only ASCII letters are folded, so this does not depend on the locale
+            if (c1 >= 'A' && c1 <= 'Z')
+                c1 += 'a' - 'A';
+            if (c2 >= 'A' && c2 <= 'Z')
+                c2 += 'a' - 'A';
+            if (c1 != c2)
+                return false;
+        }
+    }
+    return true;
+}
+
+namespace
+{
+
+int hexValue(char c)
+{
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    if (c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F')
+        return c - 'A' + 10;
+    return -1;
+}
+
+// Returns true if a backslash would start an escape code when decoding, once the rest is escaped
+bool startsEscapeCode(std::string_view str, size_t pos)
+{
+    if (pos + 1 >= str.size())
+        return true; // It would escape the closing quote
+    unsigned char next = str[pos + 1];
+    if (next < 32)
+        return true; // The next character becomes an escape code too
+    switch (next)
+    {
+        case 'n':
+        case 't':
+        case 'r':
+        case '0':
+        case 'a':
+        case 'b':
+        case 'f':
+        case 'v':
+        case '\\':
+        case '"':
+        case '\'':
+            return true;
+        case 'x':
+            return (pos + 3 < str.size() && hexValue(str[pos + 2]) >= 0 && hexValue(str[pos + 3]) >= 0);
+        default:
+            return false;
+    }
+}
+
+}
+
+bool unescape(std::string& str)
+{
+    // Finding a character uses memchr, so strings without escape codes only cost one fast scan
+    size_t in = str.find('\\');
+    if (in == std::string::npos)
+        return false;
+
+    // Decoded text is never longer than the escape code, so this can be done in place
+    size_t out = in;
+    while (in < str.size())
+    {
+        char c = str[in++];
+        if (c == '\\' && in < str.size())
+        {
+            char code = str[in++];
+            switch (code)
+            {
+                case 'n': c = '\n'; break;
+                case 't': c = '\t'; break;
+                case 'r': c = '\r'; break;
+                case '0': c = '\0'; break;
+                case 'a': c = '\a'; break;
+                case 'b': c = '\b'; break;
+                case 'f': c = '\f'; break;
+                case 'v': c = '\v'; break;
+                case '\\':
+                case '"':
+                case '\'':
+                    c = code;
+                    break;
+                case 'x':
+                    if (in + 1 < str.size() && hexValue(str[in]) >= 0 && hexValue(str[in + 1]) >= 0)
+                    {
+                        c = static_cast<char>(hexValue(str[in]) * 16 + hexValue(str[in + 1]));
+                        in += 2;
+                        break;
+                    }
+                    [[fallthrough]];
+                default:
+                    // Keep unknown codes (like in "C:\Users"), so paths still work
+                    str[out++] = '\\';
+                    c = code;
+                    break;
+            }
+        }
+        str[out++] = c;
+    }
+    str.resize(out);
+    return true;
+}
+
+void appendEscaped(std::string_view str, std::string& output)
+{
+    // Plain characters are copied in runs, only the special ones are replaced
+    static const char hexDigits[] = "0123456789abcdef";
+    size_t start = 0;
+    for (size_t i = 0; i < str.size(); ++i)
+    {
+        unsigned char c = str[i];
+        if (c >= 32 && c != '"' && c != '\\')
+            continue;
+        if (c == '\\' && !startsEscapeCode(str, i))
+            continue; // Decoding keeps unknown codes (like in "C:\Users"), so these stay the same
+        output.append(str, start, i - start);
+        start = i + 1;
+        output += '\\';
+        switch (c)
+        {
+            case '\n': output += 'n'; break;
+            case '\t': output += 't'; break;
+            case '\r': output += 'r'; break;
+            case '"': output += '"'; break;
+            case '\\': output += '\\'; break;
+            default:
+                output += 'x';
+                output += hexDigits[c >> 4];
+                output += hexDigits[c & 0xF];
+                break;
+        }
+    }
+    output.append(str, start, str.size() - start);
+}
+
+std::string escape(std::string_view str)
+{
+    std::string output;
+    output.reserve(str.size());
+    appendEscaped(str, output);
+    return output;
+}
+
+namespace
+{
+
+// Splits lines in one pass, "lineOffsets" can be null
+void splitLines(const std::string& str, std::vector<std::string>& lines, std::vector<size_t>* lineOffsets)
+{
+    // A run of CRs followed by LF is one line break, and other CRs are line breaks too
+    size_t start{0};
+    size_t pos{0};
+    while (pos < str.size())
+    {
+        char c = str[pos];
+        if (c == '\n' || c == '\r')
+        {
+            lines.push_back(str.substr(start, pos - start));
+            if (lineOffsets)
+                lineOffsets->push_back(start);
+            if (c == '\r')
+            {
+                size_t crEnd = str.find_first_not_of('\r', pos);
+                if (crEnd != std::string::npos && str[crEnd] == '\n')
+                    pos = crEnd; // Skip to the LF so the whole run is a single line break
+                else
+                {
+                    // Every other CR in the run ends an empty line, which are all added here so the run is only scanned once
+                    if (crEnd == std::string::npos)
+                        crEnd = str.size();
+                    for (size_t cr = pos + 1; cr < crEnd; ++cr)
+                    {
+                        lines.emplace_back();
+                        if (lineOffsets)
+                            lineOffsets->push_back(cr);
+                    }
+                    pos = crEnd - 1;
+                }
+            }
+            start = ++pos;
+        }
+        else
+            ++pos;
+    }
+
+    // Get the last line, if it didn't end with a new line
+    if (start < str.size())
+    {
+        lines.push_back(str.substr(start));
+        if (lineOffsets)
+            lineOffsets->push_back(start);
+    }
+}
+
+}
+
+std::vector<std::string> getLinesFromString(const std::string& str)
+{
+    std::vector<std::string> lines;
+    splitLines(str, lines, nullptr);
+    return lines;
+}
+
+std::vector<std::string> getLinesFromString(const std::string& str, std::vector<size_t>& lineOffsets)
+{
+    std::vector<std::string> lines;
+    lineOffsets.clear();
+    splitLines(str, lines, &lineOffsets);
+    return lines;
+}
+
+bool readStringFromFile(const std::string& filename, std::string& data, size_t maxSize)
 {
     bool status = false;
-    std::ifstream file(filename, std::ifstream::in); // Open the file
+    std::ifstream file(filename, std::ifstream::in | std::ifstream::binary);
     if (file.is_open())
     {
-        std::string line;
-        while (getline(file, line)) // Read a line
+        if (maxSize)
         {
-            stripNewLines(line); // Make sure to strip any leftover new line characters
-            lines.push_back(line); // Store the line
+            // Only reads up to the limit, so a huge file is never fully loaded
+            data.resize(maxSize);
+            file.read(&data[0], maxSize);
+            data.resize(file.gcount());
+        }
+        else
+        {
+            std::ostringstream stream;
+            stream << file.rdbuf(); // Read the whole file
+            data = stream.str();
         }
         status = true;
     }
     return status;
 }
 
+bool readLinesFromFile(const std::string& filename, std::vector<std::string>& lines, size_t maxSize)
+{
+    std::string data;
+    bool status = readStringFromFile(filename, data, maxSize);
+    if (status)
+        splitLines(data, lines, nullptr);
+    return status;
+}
+
 bool writeStringToFile(const std::string& filename, const std::string& data)
 {
     bool status = false;
@@ -144,7 +437,7 @@ bool writeStringToFile(const std::string& filename, const std::string& data)
 bool strToBool(const std::string& str)
 {
     // Check if the string is "true", or if the parsed value is non-zero
-    return (toLower(str) == "true" || fromString<int>(str) != 0);
+    return (iequals(str, "true") || fromString<int>(str) != 0);
 }
 
 }
@@ -5,9 +5,13 @@
 #define STRLIB_H
 
 #include <string>
+#include <string_view>
+#include <iterator>
 #include <sstream>
 #include <vector>
 #include <cctype>
+#include <charconv>
+#include <type_traits>
 
 namespace strlib
 {
@@ -44,13 +48,96 @@ std::vector<T> split(const std::string& str, const std::string& delim, T default
 template <typename T>
 std::string join(T&& elements, const std::string& sepStr);
 
+/// String views (these never allocate) ======================================
+
+// A range of the pieces of a string between delimiters, which are found while iterating
+// Follows the same rules as split(): the part after the last delimiter is only included if it is not empty
+class SplitRange
+{
+    public:
+        class iterator
+        {
+            public:
+                using iterator_category = std::forward_iterator_tag;
+                using value_type = std::string_view;
+                using difference_type = std::ptrdiff_t;
+                using pointer = const std::string_view*;
+                using reference = const std::string_view&;
+
+                iterator() {}
+                iterator(std::string_view str, std::string_view delim, size_t start);
+                reference operator*() const { return piece; }
+                pointer operator->() const { return &piece; }
+                iterator& operator++();
+                iterator operator++(int);
+                bool operator==(const iterator& other) const { return start == other.start; }
+                bool operator!=(const iterator& other) const { return start != other.start; }
+
+            private:
+                void findPiece();
+
+                std::string_view str;
+                std::string_view delim;
+                size_t start{std::string_view::npos}; // Start of the current piece, npos when done
+                size_t next{}; // Start of the next piece
+                std::string_view piece;
+        };
+
+        SplitRange(std::string_view str, std::string_view delim);
+        iterator begin() const;
+        iterator end() const;
+
+    private:
+        std::string_view str;
+        std::string_view delim;
+};
+
+// Splits a string lazily, without copying any of the pieces
+SplitRange splitView(std::string_view str, std::string_view delim);
+
+// Parses a number (or bool) with std::from_chars (leading whitespace and a "+" sign are skipped)
+// Returns true if the whole string was a valid number, "value" is only changed if something was parsed
+template <typename T>
+bool fromChars(std::string_view str, T& value);
+
+// Splits a string and parses up to "count" values into "values" (elements that are not valid use the default value)
+// Returns the number of values that were stored
+template <typename T>
+size_t splitInto(std::string_view str, std::string_view delim, T* values, size_t count, T defaultValue = 0);
+
+// Compares two strings while ignoring the case of ASCII letters
+bool iequals(std::string_view str1, std::string_view str2);
+
+// Joins elements from any container, appending them to "output" (which can be reused to avoid allocating)
+template <typename T>
+void join(T&& elements, std::string_view sepStr, std::string& output);
+
+// Replaces escape codes (like "\n" or "\x41") with the characters they represent, returns true if there were any
+// Strings without a backslash are not changed at all, and unknown escape codes are kept as they are
+bool unescape(std::string& str);
+
+// Appends a string with quotes, backslashes, and control characters replaced by escape codes
+// Backslashes that unescape would keep (like in "C:\Users") are not escaped, so they stay readable
+void appendEscaped(std::string_view str, std::string& output);
+
+// Same as above, but returns a new string
+std::string escape(std::string_view str);
+
 /// File operations ===========================================================
 
 // Splits a string into separate lines using the CR and/or LF characters
 std::vector<std::string> getLinesFromString(const std::string& str);
 
+// Same as above, but also stores the offset of each line within the original string
+std::vector<std::string> getLinesFromString(const std::string& str, std::vector<size_t>& lineOffsets);
+
+// Reads an entire file into a string, without any new line conversion
+// If maxSize is set, stops reading after that many bytes
+bool readStringFromFile(const std::string& filename, std::string& data, size_t maxSize = 0);
+
 // Reads a file into a vector as separate lines
-bool readLinesFromFile(const std::string& filename, std::vector<std::string>& lines);
+// If maxSize is set, only the lines in the first maxSize bytes are read
+bool readLinesFromFile(const std::string& filename, std::vector<std::string>& lines, size_t maxSize = 0);
 
 // Writes a string to a file, will overwrite an existing file
 bool writeStringToFile(const std::string& filename, const std::string& data);
@@ -61,9 +148,14 @@ bool writeStringToFile(const std::string& filename, const std::string& data);
 // Parses a string to determine its boolean value
 bool strToBool(const std::string& str);
 
-// Converts most types to strings using a string stream
+// Converts most types to strings
+// Numbers use the shortest text that converts back to exactly the same value
 template <typename T>
-std::string toString(T data, unsigned precision = 16)
+std::string toString(T data);
+
+// Converts most types to strings using a string stream, with a specific precision
+template <typename T>
+std::string toString(T data, unsigned precision)
 {
     std::ostringstream tmp;
     tmp.precision(precision);
@@ -92,6 +184,28 @@ T fromString(const std::string& str, T defaultValue = 0)
 
 /// Template implementations ===================================================
 
+// Characters and bools are not formatted as numbers
+template <typename T>
+struct isFormattedNumber: std::integral_constant<bool, std::is_arithmetic<T>::value &&
+    !std::is_same<T, bool>::value && !std::is_same<T, char>::value &&
+    !std::is_same<T, signed char>::value && !std::is_same<T, unsigned char>::value &&
+    !std::is_same<T, wchar_t>::value && !std::is_same<T, char16_t>::value &&
+    !std::is_same<T, char32_t>::value> {};
+
+template <typename T>
+std::string toString(T data)
+{
+    if constexpr (isFormattedNumber<T>::value)
+    {
+        // Large enough for the longest double (the shortest round trip is at most 24 characters)
+        char buffer[64];
+        auto result = std::to_chars(buffer, buffer + sizeof(buffer), data);
+        return std::string(buffer, result.ptr);
+    }
+    else
+        return toString<T>(data, 16);
+}
+
 template <typename T>
 std::vector<T> split(const std::string& str, const std::string& delim, T defaultValue)
 {
@@ -106,6 +220,87 @@ std::vector<T> split(const std::string& str, const std::string& delim, T default
     return values;
 }
 
+template <typename T>
+bool fromChars(std::string_view str, T& value)
+{
+    size_t pos{0};
+    while (pos < str.size() && std::isspace(static_cast<unsigned char>(str[pos])))
+        ++pos;
+    if (pos < str.size() && str[pos] == '+')
+    {
+        // Only one sign is allowed, so "+-5" is not a number
+        if (++pos < str.size() && str[pos] == '-')
+            return false;
+    }
+    const char* first = str.data() + pos;
+    const char* last = str.data() + str.size();
+    if constexpr (std::is_same<T, bool>::value)
+    {
+        // Booleans are either "true", "false", or a number
+        std::string_view word(first, last - first);
+        bool isTrue = iequals(word, "true");
+        if (isTrue || iequals(word, "false"))
+        {
+            value = isTrue;
+            return true;
+        }
+        long number{};
+        auto result = std::from_chars(first, last, number);
+        if (result.ec != std::errc())
+            return false;
+        value = (number != 0);
+        return (result.ptr == last);
+    }
+    else
+    {
+        // Only digits are accepted, not "inf" or "nan" (same as string streams)
+        const char* digits = (first != last && *first == '-' ? first + 1 : first);
+        if (digits == last || !(std::isdigit(static_cast<unsigned char>(*digits)) || *digits == '.'))
+            return false;
+        auto result = std::from_chars(first, last, value);
+        return (result.ec == std::errc() && result.ptr == last);
+    }
+}
+
+template <typename T>
+size_t splitInto(std::string_view str, std::string_view delim, T* values, size_t count, T defaultValue)
+{
+    size_t stored{0};
+    for (auto piece: splitView(str, delim))
+    {
+        if (stored >= count)
+            break;
+        T value = defaultValue;
+        if (!fromChars(piece, value))
+            value = defaultValue;
+        values[stored++] = value;
+    }
+    return stored;
+}
+
+template <typename T>
+void join(T&& elements, std::string_view sepStr, std::string& output)
+{
+    bool first = true;
+    for (const auto& elem: elements)
+    {
+        if (!first)
+            output += sepStr;
+        first = false;
+        using Elem = typename std::decay<decltype(elem)>::type;
+        if constexpr (std::is_convertible<const Elem&, std::string_view>::value)
+            output += std::string_view(elem);
+        else if constexpr (isFormattedNumber<Elem>::value)
+        {
+            char buffer[64];
+            auto result = std::to_chars(buffer, buffer + sizeof(buffer), elem);
+            output.append(buffer, result.ptr);
+        }
+        else
+            output += toString<Elem>(elem);
+    }
+}
+
 template <typename T>
 std::string join(T&& elements, const std::string& sepStr)
 {